@@ -43,6 +43,26 @@ double Config::MapReduce::GetCPUMultiplier() {
     return 0.5;
 }
 
+unsigned Config::MapReduce::GetFunctionCacheSize() {
+    return 32;
+}
+
+unsigned Config::MapReduce::GetTempViewCacheSize() {
+    return 1024 * 1024;
+}
+
+unsigned Config::MapReduce::GetMapBatchSize() {
+    return 256;
+}
+
+unsigned Config::MapReduce::GetMapRangeSize() {
+    return 4096;
+}
+
+unsigned Config::MapReduce::GetQueryTimeout() {
+    return 60000;
+}
+
 unsigned Config::Data::GetDatabaseDeleteDelay() {
     return 5;
 }
\ No newline at end of file
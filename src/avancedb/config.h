@@ -34,6 +34,24 @@ public:
     
     struct MapReduce final {
         static double GetCPUMultiplier();
+        
+        /// The number of compiled map functions each map/reduce runtime keeps
+        static unsigned GetFunctionCacheSize();
+        
+        /// The maximum number of map rows each database keeps in its temp view cache
+        static unsigned GetTempViewCacheSize();
+        
+        /// The number of documents passed to a JavaScript map function with each call
+        /// into the runtime, a batch size of 1 calls the map function directly
+        static unsigned GetMapBatchSize();
+        
+        /// The number of documents in each range of a shard which is mapped as a
+        /// separate task, so large shards are spread across the map threads
+        static unsigned GetMapRangeSize();
+        
+        /// The amount of time, in milliseconds, a view query may spend mapping and
+        /// reducing before it is cancelled
+        static unsigned GetQueryTimeout();
     };
     
     struct Data final {
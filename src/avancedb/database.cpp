@@ -102,4 +102,8 @@ BulkDocumentsResults Database::PostBulkDocuments(script_array_ptr docs, bool new
 
 map_reduce_results_ptr Database::PostTempView(const GetViewOptions& options, rs::scriptobject::ScriptObjectPtr obj) {
     return docs_->PostTempView(options, obj);
+}
+
+map_reduce_results_ptr Database::GetDesignDocumentView(const GetViewOptions& options, const char* designId, const char* viewId) {
+    return docs_->GetDesignDocumentView(options, designId, viewId);
 }
\ No newline at end of file
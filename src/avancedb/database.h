@@ -63,6 +63,7 @@ public:
     BulkDocumentsResults PostBulkDocuments(script_array_ptr docs, bool newEdits);
     
     map_reduce_results_ptr PostTempView(const GetViewOptions& options, rs::scriptobject::ScriptObjectPtr obj);
+    map_reduce_results_ptr GetDesignDocumentView(const GetViewOptions& options, const char* designId, const char* viewId);
     
 private:
     friend database_ptr boost::make_shared<database_ptr::element_type>(const char*&);
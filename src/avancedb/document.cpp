@@ -26,10 +26,18 @@
 #include "document_revision.h"
 #include "city.h"
 
-Document::Document(script_object_ptr obj, sequence_type seqNum) : obj_(obj), id_(obj->getString("_id")), rev_(obj->getString("_rev")), seqNum_(seqNum) {
+Document::Document(script_object_ptr obj, sequence_type seqNum) : obj_(obj), id_(obj->getString("_id")), rev_(obj->getString("_rev")), seqNum_(seqNum), idHash_(getIdHash(id_)) {
 }
 
 document_ptr Document::Create(const char* id, script_object_ptr obj, sequence_type seqNum, bool incrementRev) {
+    return Create(Prepare(id, obj, incrementRev), seqNum);
+}
+
+document_ptr Document::Create(script_object_ptr preparedObj, sequence_type seqNum) {
+    return boost::make_shared<document_ptr::element_type>(preparedObj, seqNum);
+}
+
+script_object_ptr Document::Prepare(const char* id, script_object_ptr obj, bool incrementRev, bool copy) {
     const char* oldRev = obj->getString("_rev", false);
     const char* newRev = nullptr;
     DocumentRevision::RevString newRevString;
@@ -46,28 +54,24 @@ document_ptr Document::Create(const char* id, script_object_ptr obj, sequence_ty
         newRev = newRevString.data();
     }
     
-    document_ptr doc;
-    if (obj->getType("_id") == rs::scriptobject::ScriptObjectType::String &&
+    if (!copy && 
+        obj->getType("_id") == rs::scriptobject::ScriptObjectType::String &&
         oldRev != nullptr &&
         obj->setString("_id", id) &&
         (newRev == nullptr || obj->setString("_rev", newRev))) {
-        doc = boost::make_shared<document_ptr::element_type>(obj, seqNum);
-    } else {
-        rs::scriptobject::utils::ObjectVector tempDefn = {
-            std::make_pair("_id", rs::scriptobject::utils::VectorValue(id)),
-            std::make_pair("_rev", rs::scriptobject::utils::VectorValue(newRev ? newRev : oldRev))
-        };
-        
-        rs::scriptobject::utils::ScriptObjectVectorSource tempSource(tempDefn);
-        
-        auto tempObj = rs::scriptobject::ScriptObjectFactory::CreateObject(tempSource);
-        
-        auto newObj = rs::scriptobject::ScriptObject::Merge(obj, tempObj, rs::scriptobject::ScriptObject::MergeStrategy::Front);
-        
-        doc = boost::make_shared<document_ptr::element_type>(newObj, seqNum);
+        return obj;
     }
     
-    return doc;
+    rs::scriptobject::utils::ObjectVector tempDefn = {
+        std::make_pair("_id", rs::scriptobject::utils::VectorValue(id)),
+        std::make_pair("_rev", rs::scriptobject::utils::VectorValue(newRev ? newRev : oldRev))
+    };
+
+    rs::scriptobject::utils::ScriptObjectVectorSource tempSource(tempDefn);
+
+    auto tempObj = rs::scriptobject::ScriptObjectFactory::CreateObject(tempSource);
+
+    return rs::scriptobject::ScriptObject::Merge(obj, tempObj, rs::scriptobject::ScriptObject::MergeStrategy::Front);
 }
 
 const char* Document::getId() const {
@@ -75,7 +79,7 @@ const char* Document::getId() const {
 }
 
 std::uint64_t Document::getIdHash() const {
-    return getIdHash(id_);
+    return idHash_;
 }
 
 std::uint64_t Document::getIdHash(const char* id) {    
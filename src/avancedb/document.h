@@ -59,6 +59,12 @@ public:
     
     static document_ptr Create(const char* id, script_object_ptr obj, sequence_type seqNum, bool incrementRev = true);
     
+    // Prepare sets the id and revision, which includes hashing the object, so only the cheap
+    // Create from the prepared object needs to be done under the collection lock, the fields are
+    // set in place where they fit unless copy is set, for an object shared with a stored document
+    static script_object_ptr Prepare(const char* id, script_object_ptr obj, bool incrementRev = true, bool copy = false);
+    static document_ptr Create(script_object_ptr preparedObj, sequence_type seqNum);
+    
     const char* getId() const;
     std::uint64_t getIdHash() const;
     static std::uint64_t getIdHash(const char*);
@@ -79,6 +85,7 @@ private:
     const char* id_;
     const char* rev_;
     const sequence_type seqNum_;
+    const std::uint64_t idHash_;
 
 };
 
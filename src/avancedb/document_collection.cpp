@@ -18,54 +18,369 @@
 
 #include "document_collection.h"
 
-DocumentCollection::DocumentCollection(unsigned maxUnsortedEntries, unsigned maxNurseryEntries) : coll_(maxUnsortedEntries, maxNurseryEntries) {
+#include <cstring>
+#include <algorithm>
+
+DocumentCollection::DocumentCollection(unsigned maxNurseryEntries) : run_(boost::make_shared<document_array>()), 
+        maxNurseryEntries_(maxNurseryEntries), index_(boost::make_shared<Index>(16)) {
     
 }
 
-document_collection_ptr DocumentCollection::Create(unsigned maxUnsortedEntries, unsigned maxNurseryEntries) {
-    return boost::make_shared<DocumentCollection>(maxUnsortedEntries, maxNurseryEntries);
+document_collection_ptr DocumentCollection::Create(unsigned maxNurseryEntries) {
+    return boost::make_shared<DocumentCollection>(maxNurseryEntries);
 }
 
-DocumentCollection::collection::const_iterator DocumentCollection::cbegin() {
-    return coll_.cbegin();
+void DocumentCollection::lock() const { 
+    mtx_.lock(); 
 }
 
-DocumentCollection::collection::const_iterator DocumentCollection::cend() {
-    return coll_.cend();
+bool DocumentCollection::try_lock() const { 
+    return mtx_.try_lock(); 
 }
 
-DocumentCollection::const_reference DocumentCollection::operator[](int index) const {
-    return coll_[index];
+void DocumentCollection::unlock() { 
+    // writers which are never read from merge the nursery themselves once it is
+    // larger than the run, which keeps the merges amortized
+    boost::unique_lock<boost::mutex> lock{mtx_, boost::adopt_lock};
+    if (!frozen_ && nursery_.size() > std::max(maxNurseryEntries_, run_->size())) {
+        Compact(lock);
+    }
 }
 
-void DocumentCollection::lock() const { 
-    mtx_.lock(); 
+DocumentCollection::size_type DocumentCollection::size() const {
+    return size_;
 }
 
-bool DocumentCollection::try_lock() const { 
-    return mtx_.try_lock(); 
+void DocumentCollection::insert(const value_type& k) {
+    // a free slot is always left for the probe sequences to end at
+    if ((index_->used_ + 1) * 2 > index_->capacity_) {
+        Rehash();
+    }
+    
+    auto replaced = Publish(*index_, k, false);
+    if (!replaced) {
+        ++size_;
+    }
+    
+    Log(k, false, !!replaced);
+    LogChange(k, replaced);
 }
 
-void DocumentCollection::unlock() const { 
-    mtx_.unlock(); 
+DocumentCollection::size_type DocumentCollection::erase(const value_type& k) {
+    auto replaced = Publish(*index_, k, true);
+    if (!replaced) {
+        return 0;
+    }
+    
+    --size_;
+    Log(k, true, true);
+    LogChange(k, replaced);
+    return 1;
 }
 
-DocumentCollection::size_type DocumentCollection::size() const {
-    return coll_.size();
+document_ptr DocumentCollection::find(const char* id) const {
+    return find(id, Document::getIdHash(id));
 }
 
-void DocumentCollection::insert(const collection::value_type& k) {
-    return coll_.insert(k);
+document_ptr DocumentCollection::find(const char* id, std::uint64_t hash) const {
+    auto index = boost::atomic_load(&index_);
+    hash = GetIndexHash(hash);
+    
+    const auto mask = index->capacity_ - 1;
+    for (auto i = GetSlotIndex(*index, hash), probes = index->capacity_; probes > 0; i = (i + 1) & mask, --probes) {
+        auto& slot = index->slots_[i];
+        auto slotHash = slot.hash_.load(std::memory_order_acquire);
+        if (slotHash == 0) {
+            break;
+        }
+        
+        if (slotHash == hash) {
+            auto doc = boost::atomic_load(&slot.doc_);
+            if (!!doc && std::strcmp(id, doc->getId()) == 0) {
+                return doc;
+            }
+        }
+    }
+    
+    return nullptr;
 }
 
-DocumentCollection::size_type DocumentCollection::erase(const collection::value_type& k) {
-    return coll_.erase(k);
+std::uint64_t DocumentCollection::GetIndexHash(std::uint64_t hash) {
+    // zero marks an empty slot
+    return hash != 0 ? hash : 1;
 }
 
-DocumentCollection::collection::value_type_ptr DocumentCollection::find_fn(collection::compare_type compare) {
-    return coll_.find_fn(compare);
+DocumentCollection::size_type DocumentCollection::GetSlotIndex(const Index& index, std::uint64_t hash) {
+    // the low bits of the hash already pick the collection
+    return (hash >> 32) & (index.capacity_ - 1);
 }
 
-void DocumentCollection::copy(std::vector<collection::value_type>& coll, bool sort) {
-    coll_.copy(coll, sort);
-}
\ No newline at end of file
+document_ptr DocumentCollection::Publish(Index& index, const value_type& doc, bool erase) {
+    // writers hold the collection lock so only the readers need the atomic access
+    const auto hash = GetIndexHash(doc->getIdHash());
+    const auto mask = index.capacity_ - 1;
+    
+    Slot* freeSlot = nullptr;
+    for (auto i = GetSlotIndex(index, hash), probes = index.capacity_; probes > 0; i = (i + 1) & mask, --probes) {
+        auto& slot = index.slots_[i];
+        auto slotHash = slot.hash_.load(std::memory_order_relaxed);
+        if (slotHash == 0) {
+            freeSlot = !!freeSlot ? freeSlot : &slot;
+            break;
+        }
+        
+        if (!slot.doc_) {
+            freeSlot = !!freeSlot ? freeSlot : &slot;
+        } else if (slotHash == hash && std::strcmp(doc->getId(), slot.doc_->getId()) == 0) {
+            auto replaced = slot.doc_;
+            boost::atomic_store(&slot.doc_, erase ? document_ptr{} : doc);
+            return replaced;
+        }
+    }
+    
+    if (!erase) {
+        if (freeSlot->hash_.load(std::memory_order_relaxed) == 0) {
+            ++index.used_;
+        }
+        
+        boost::atomic_store(&freeSlot->doc_, doc);
+        freeSlot->hash_.store(hash, std::memory_order_release);
+    }
+    
+    return nullptr;
+}
+
+void DocumentCollection::Rehash() {
+    // erased slots are dropped and the table is left a quarter full
+    size_type capacity = 16;
+    while (capacity < (size_ + 1) * 4) {
+        capacity *= 2;
+    }
+    
+    auto index = boost::make_shared<Index>(capacity);
+    for (size_type i = 0; i < index_->capacity_; ++i) {
+        const auto& doc = index_->slots_[i].doc_;
+        if (!!doc) {
+            Publish(*index, doc, false);
+        }
+    }
+    
+    boost::atomic_store(&index_, index);
+}
+
+document_array_ptr DocumentCollection::snapshot() {
+    size_type position = 0;
+    return snapshot(position);
+}
+
+document_array_ptr DocumentCollection::snapshot(size_type& position) {
+    boost::unique_lock<boost::mutex> lock{mtx_};
+    position = changesBegin_ + changes_.size();
+    if (!frozen_) {
+        return nursery_.empty() ? run_ : Compact(lock);
+    }
+    
+    // another merge is being published, this snapshot merges the same writes
+    // itself rather than waiting on it and isn't published
+    auto run = run_;
+    auto frozen = frozen_;
+    auto nursery = nursery_;
+    lock.unlock();
+    
+    auto docs = Merge(*run, *frozen);
+    return nursery.empty() ? docs : Merge(*docs, nursery);
+}
+
+DocumentCollection::Version DocumentCollection::version(const char* startId, bool inclusiveStart, const char* endId, bool inclusiveEnd, bool descending, size_type count) {
+    const Range range{startId, inclusiveStart, endId, inclusiveEnd, descending};
+    
+    // only the writes within the range are copied under the lock
+    entry_array entries;
+    auto truncated = false;
+    boost::unique_lock<boost::mutex> lock{mtx_};
+    if (!frozen_ && nursery_.size() > maxNurseryEntries_) {
+        Compact(lock);
+    }
+    
+    const auto size = size_;
+    auto run = run_;
+    auto frozen = frozen_;
+    auto offset = Seek(nursery_, range, count, entries, truncated);
+    lock.unlock();
+    
+    if (!!frozen) {
+        // a frozen write can only be hidden by an erasure in the nursery, so with as
+        // many more documents the frozen writes reach as far as the nursery's
+        size_type erasures = std::count_if(entries.cbegin(), entries.cend(), [](const NurseryEntry& entry) { 
+            return entry.erase_; 
+        });
+        
+        entry_array frozenEntries;
+        auto frozenTruncated = false;
+        offset += Seek(*frozen, range, count + erasures, frozenEntries, frozenTruncated);
+        
+        // the writes are overlaid up to where the first of the two stopped
+        IdLess less;
+        auto before = [&](const NurseryEntry& a, const NurseryEntry& b) {
+            return descending ? less(b.doc_->getId(), a.doc_->getId()) : less(a.doc_->getId(), b.doc_->getId());
+        };
+        
+        entry_array writes;
+        auto iter = entries.cbegin();
+        auto frozenIter = frozenEntries.cbegin();
+        while ((iter != entries.cend() || !truncated) && (frozenIter != frozenEntries.cend() || !frozenTruncated)) {
+            if (iter == entries.cend() && frozenIter == frozenEntries.cend()) {
+                break;
+            } else if (frozenIter == frozenEntries.cend() || (iter != entries.cend() && before(*iter, *frozenIter))) {
+                writes.push_back(*iter++);
+            } else if (iter == entries.cend() || before(*frozenIter, *iter)) {
+                writes.push_back(*frozenIter++);
+            } else {
+                // the nursery's write is the later one
+                writes.push_back(*iter++);
+                ++frozenIter;
+            }
+        }
+        
+        entries.swap(writes);
+    }
+    
+    auto added = boost::make_shared<document_array>();
+    auto erased = boost::make_shared<document_array>();
+    for (const auto& entry : entries) {
+        (entry.erase_ ? erased : added)->push_back(entry.doc_);
+    }
+    
+    return Version{run, added, erased, size, offset};
+}
+
+std::ptrdiff_t DocumentCollection::GetSizeDelta(const NurseryEntry& entry) {
+    return (entry.erase_ ? 0 : 1) - (entry.inBase_ ? 1 : 0);
+}
+
+std::ptrdiff_t DocumentCollection::Seek(const nursery_type& nursery, const Range& range, size_type count, entry_array& entries, bool& truncated) {
+    IdLess less;
+    auto hasStart = !!range.startId_ && range.startId_[0] != '\0';
+    auto hasEnd = !!range.endId_ && range.endId_[0] != '\0';
+    
+    auto first = nursery.cbegin();
+    if (hasStart) {
+        first = range.inclusiveStart_ ? nursery.lower_bound(range.startId_) : nursery.upper_bound(range.startId_);
+    }
+    
+    auto last = nursery.cend();
+    if (hasEnd) {
+        last = range.inclusiveEnd_ ? nursery.upper_bound(range.endId_) : nursery.lower_bound(range.endId_);
+    }
+    
+    if (hasStart && hasEnd && (less(range.endId_, range.startId_) || 
+            (!less(range.startId_, range.endId_) && !(range.inclusiveStart_ && range.inclusiveEnd_)))) {
+        last = first;
+    }
+    
+    if (!range.descending_) {
+        return Seek(nursery.cbegin(), first, last, count, entries, truncated);
+    } else {
+        using reverse_iterator = nursery_type::const_reverse_iterator;
+        return Seek(reverse_iterator{nursery.cend()}, reverse_iterator{last}, reverse_iterator{first}, count, entries, truncated);
+    }
+}
+
+template <typename Iter>
+std::ptrdiff_t DocumentCollection::Seek(Iter iter, Iter begin, Iter end, size_type count, entry_array& entries, bool& truncated) {
+    // the entries before the range are only counted
+    std::ptrdiff_t offset = 0;
+    for (; iter != begin; ++iter) {
+        offset += GetSizeDelta(iter->second);
+    }
+    
+    for (size_type added = 0; begin != end && added < count; ++begin) {
+        entries.push_back(begin->second);
+        if (!begin->second.erase_) {
+            ++added;
+        }
+    }
+    
+    truncated = begin != end;
+    return offset;
+}
+
+void DocumentCollection::Log(const value_type& doc, bool erase, bool existed) {
+    // an id written again keeps whether it was in the base but takes the new document,
+    // whose id becomes the key
+    auto iter = nursery_.find(doc->getId());
+    if (iter != nursery_.end()) {
+        existed = iter->second.inBase_;
+        iter = nursery_.erase(iter);
+    }
+    
+    nursery_.emplace_hint(iter, doc->getId(), NurseryEntry{doc, erase, existed});
+}
+
+void DocumentCollection::LogChange(const value_type& doc, const document_ptr& replaced) {
+    changes_.push_back(Change{doc->getId(), replaced.get()});
+    
+    while (changes_.size() > std::max(maxNurseryEntries_, size_)) {
+        changes_.pop_front();
+        ++changesBegin_;
+    }
+}
+
+bool DocumentCollection::changes(size_type& position, std::vector<Change>& changes) const {
+    boost::lock_guard<boost::mutex> guard{mtx_};
+    if (position < changesBegin_) {
+        return false;
+    }
+    
+    changes.insert(changes.end(), changes_.cbegin() + (position - changesBegin_), changes_.cend());
+    position = changesBegin_ + changes_.size();
+    return true;
+}
+
+bool DocumentCollection::IdLess::operator()(const char* a, const char* b) const {
+    return std::strcmp(a, b) < 0;
+}
+
+document_array_ptr DocumentCollection::Compact(boost::unique_lock<boost::mutex>& lock) {
+    // writes made while merging go to a new nursery on top of the new run
+    auto frozen = boost::make_shared<nursery_type>();
+    frozen->swap(nursery_);
+    frozen_ = frozen;
+    auto run = run_;
+    lock.unlock();
+    
+    auto docs = Merge(*run, *frozen);
+    
+    lock.lock();
+    run_ = docs;
+    frozen_.reset();
+    return docs;
+}
+
+document_array_ptr DocumentCollection::Merge(const document_array& run, const nursery_type& nursery) {
+    auto docs = boost::make_shared<document_array>();
+    docs->reserve(run.size() + nursery.size());
+    
+    IdLess less;
+    auto iter = nursery.cbegin();
+    for (const auto& doc : run) {
+        for (; iter != nursery.cend() && less(iter->first, doc->getId()); ++iter) {
+            if (!iter->second.erase_) {
+                docs->push_back(iter->second.doc_);
+            }
+        }
+        
+        // a document which has been written again or erased is replaced by its last write
+        if (iter == nursery.cend() || less(doc->getId(), iter->first)) {
+            docs->push_back(doc);
+        }
+    }
+    
+    for (; iter != nursery.cend(); ++iter) {
+        if (!iter->second.erase_) {
+            docs->push_back(iter->second.doc_);
+        }
+    }
+    
+    return docs;
+}
@@ -22,44 +22,152 @@
 #include "types.h"
 #include "document.h"
 
+#include <cstddef>
 #include <vector>
+#include <map>
+#include <deque>
+#include <string>
+#include <memory>
+#include <atomic>
 
 #include <boost/thread.hpp>
 #include <boost/make_shared.hpp>
 
-#include "../../externals/lazyflatset/lazyflatset.hpp"
-
 class DocumentCollection final {
 public:
-    using collection = rs::LazyFlatSet<document_ptr, Document::Less, Document::Equal, rs::LazyFlatSetQuickSort<document_ptr, Document::Less>, std::allocator<document_ptr>, true>;
-    using const_iterator = collection::const_iterator;
-    using const_reference = collection::const_reference;
-    using size_type = collection::size_type;
-    
-    static document_collection_ptr Create(unsigned maxUnsortedEntries = 16, unsigned maxNurseryEntries = 1024);
-    
-    collection::const_iterator cbegin();
-    collection::const_iterator cend();
+    using value_type = document_ptr;
+    using size_type = document_array::size_type;
     
-    const_reference operator[](int index) const;
+    static document_collection_ptr Create(unsigned maxNurseryEntries = 1024);
     
+    // a writer which leaves the nursery larger than the run merges it into a new run
+    // once the collection lock has been released
     void lock() const;
     bool try_lock() const;
-    void unlock() const;
+    void unlock();
     
     size_type size() const;
-    void insert(const collection::value_type&);
-    size_type erase(const collection::value_type&);
-    void copy(std::vector<collection::value_type>& coll, bool sort = true);
-    collection::value_type_ptr find_fn(collection::compare_type);
+    void insert(const value_type&);
+    size_type erase(const value_type&);
+    
+    // the sorted documents, shared by every reader until the next write and iterated
+    // without the collection lock, snapshot takes the lock itself so it mustn't be held,
+    // position is set to the end of the change log as of the snapshot
+    document_array_ptr snapshot();
+    document_array_ptr snapshot(size_type& position);
+    
+    // every write is logged with the document it replaced or erased, compared by address
+    // only since it may have been freed, so a reader can follow the collection from a
+    // position without walking it, the log keeps about as many changes as documents
+    struct Change final {
+        std::string id_;
+        const Document* replaced_;
+    };
+    
+    // appends the changes since position and moves it to the end of the log, returns
+    // false if they have already been dropped from the log
+    bool changes(size_type& position, std::vector<Change>& changes) const;
+    
+    // the last snapshot and the documents added or erased since within a range of ids,
+    // so a reader can seek the range without merging the whole collection, the writes
+    // are in iteration order and stop once count documents have been added, offset is
+    // how much the writes before the range changed the number of documents before it
+    struct Version final {
+        document_array_ptr docs_;
+        document_array_ptr added_;
+        document_array_ptr erased_;
+        size_type size_;
+        std::ptrdiff_t offset_;
+    };
+    
+    // the range runs from startId to endId in id order whatever the direction, a
+    // null or empty id leaves that end of the range open
+    Version version(const char* startId, bool inclusiveStart, const char* endId, bool inclusiveEnd, bool descending, size_type count);
+    
+    // searches the hash index, so it doesn't need the collection lock, the hash is the
+    // id hash which also picks the collection, the table and slot documents are
+    // shared_ptrs loaded with boost::atomic_load which goes through boost's spinlock
+    // pool, so a lookup never waits on a writer but isn't strictly lock-free
+    document_ptr find(const char* id) const;
+    document_ptr find(const char* id, std::uint64_t hash) const;
     
 private:
     
-    friend document_collection_ptr boost::make_shared<document_collection_ptr::element_type>(unsigned&, unsigned&);
+    friend document_collection_ptr boost::make_shared<document_collection_ptr::element_type>(unsigned&);
+    
+    DocumentCollection(unsigned maxNurseryEntries);
+    
+    // an open addressing table keyed by the id hash, a slot's hash is only set once its
+    // document has been stored and erased documents leave the hash behind so the probe
+    // sequences of other documents aren't broken, a document which has been replaced is
+    // freed once the last reader releases it
+    struct Slot final {
+        std::atomic<std::uint64_t> hash_{0};
+        document_ptr doc_;
+    };
+    
+    struct Index final {
+        explicit Index(size_type capacity) : slots_(new Slot[capacity]), capacity_(capacity) {}
+        
+        std::unique_ptr<Slot[]> slots_;
+        const size_type capacity_;
+        size_type used_{0};
+    };
+    
+    using index_ptr = boost::shared_ptr<Index>;
+    
+    static std::uint64_t GetIndexHash(std::uint64_t hash);
+    static size_type GetSlotIndex(const Index& index, std::uint64_t hash);
+    static document_ptr Publish(Index& index, const value_type& doc, bool erase);
+    void Rehash();
+    
+    // the last snapshot is kept as an immutable sorted run and the last write to each
+    // id since is kept in the nursery, sorted by id so readers can seek it, to merge
+    // them the nursery is frozen and a new one is started, the frozen writes are merged
+    // outside of the lock and the result is published as the new run, only one merge
+    // is published at a time
+    struct NurseryEntry final {
+        document_ptr doc_;
+        bool erase_;
+        
+        // whether the id was in the run or the frozen writes below this entry
+        bool inBase_;
+    };
+    
+    struct IdLess final {
+        bool operator()(const char* a, const char* b) const;
+    };
+    
+    // the keys are the ids of the entries' documents
+    using nursery_type = std::map<const char*, NurseryEntry, IdLess>;
+    using nursery_ptr = boost::shared_ptr<const nursery_type>;
+    using entry_array = std::vector<NurseryEntry>;
+    
+    struct Range final {
+        const char* startId_;
+        bool inclusiveStart_;
+        const char* endId_;
+        bool inclusiveEnd_;
+        bool descending_;
+    };
     
-    DocumentCollection(unsigned maxUnsortedEntries, unsigned maxNurseryEntries);
+    static std::ptrdiff_t GetSizeDelta(const NurseryEntry& entry);
+    static std::ptrdiff_t Seek(const nursery_type& nursery, const Range& range, size_type count, entry_array& entries, bool& truncated);
+    template <typename Iter>
+    static std::ptrdiff_t Seek(Iter iter, Iter begin, Iter end, size_type count, entry_array& entries, bool& truncated);
+    static document_array_ptr Merge(const document_array& run, const nursery_type& nursery);
+    void Log(const value_type& doc, bool erase, bool existed);
+    document_array_ptr Compact(boost::unique_lock<boost::mutex>& lock);
+    void LogChange(const value_type& doc, const document_ptr& replaced);
     
-    collection coll_;
+    document_array_ptr run_;
+    nursery_ptr frozen_;
+    nursery_type nursery_;
+    size_type size_{0};
+    const size_type maxNurseryEntries_;
+    index_ptr index_;
+    std::deque<Change> changes_;
+    size_type changesBegin_{0};
     
     mutable boost::mutex mtx_;
     char padding_[64];
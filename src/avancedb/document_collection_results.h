@@ -26,10 +26,10 @@
 
 class DocumentCollectionResults final {
 public:
-    using const_iterator = DocumentCollection::const_iterator;
-    using size_type = DocumentCollection::size_type;
+    using const_iterator = document_array::const_iterator;
+    using size_type = document_array::size_type;
     
-    DocumentCollectionResults(document_collection_ptr docs, size_type limit, const char* key, const char* startKey, const char* endKey, bool inclusiveEnd, bool descending);
+    DocumentCollectionResults(document_array_ptr docs, size_type limit, const char* key, const char* startKey, const char* endKey, bool inclusiveEnd, bool descending);
     
     size_type Offset() const;
     size_type FilteredRows() const;
@@ -42,11 +42,11 @@ private:
     
     const size_type FindMissedFlag = ~(std::numeric_limits<size_type>::max() / 2);
     
-    static size_type FindDocument(const DocumentCollection& docs, const char* key);
+    static size_type FindDocument(const document_array& docs, const char* key);
     
     static size_type Subtract(size_type, size_type);
     
-    const document_collection_ptr docs_;
+    const document_array_ptr docs_;
     const bool inclusiveEnd_;
     const bool descending_;
     size_type startIndex_;
@@ -19,10 +19,12 @@
 #include "documents.h"
 
 #include <algorithm>
+#include <iterator>
 
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/optional.hpp>
 
 #include "document.h"
 #include "document_collection.h"
@@ -33,16 +35,20 @@
 #include "config.h"
 #include "uuid_helper.h"
 #include "map_reduce_result.h"
+#include "map_reduce_view.h"
+#include "map_reduce_result_array.h"
+#include "map_reduce_task_group.h"
+#include "set_thread_name.h"
+#include "thread_pool.hpp"
+#include "city.h"
 
 Documents::Documents(database_ptr db) : db_(db), docCount_(0),
         dataSize_(0), updateSeq_(0), localUpdateSeq_(0),
         collections_(GetCollectionCount()),
-        allDocsCacheDocs_(boost::make_shared<document_array>()),
-        allDocsCacheUpdateSequence_(0),
         localDocs_(DocumentCollection::Create()) {
    
     for (unsigned i = 0; i < collections_; ++i) {
-        docs_.emplace_back(DocumentCollection::Create(64, 32 * 1024));
+        docs_.emplace_back(DocumentCollection::Create(32 * 1024));
     }
 }
 
@@ -63,12 +69,10 @@ sequence_type Documents::getUpdateSequence() {
 }
 
 document_ptr Documents::GetDocument(const char* id, bool throwOnFail) {
-    auto coll = GetDocumentCollectionIndex(id);
-    
-    boost::lock_guard<DocumentCollection> guard{*docs_[coll]};
+    auto hash = Document::getIdHash(id);
+    auto coll = GetDocumentCollectionIndex(hash);
     
-    Document::Compare compare{id};
-    auto doc = docs_[coll]->find_fn(compare);
+    auto doc = docs_[coll]->find(id, hash);
     
     if (!doc && throwOnFail) {
         throw DocumentMissing{};
@@ -78,12 +82,12 @@ document_ptr Documents::GetDocument(const char* id, bool throwOnFail) {
 }
 
 document_ptr Documents::DeleteDocument(const char* id, const char* rev) {
-    auto coll = GetDocumentCollectionIndex(id);
+    auto hash = Document::getIdHash(id);
+    auto coll = GetDocumentCollectionIndex(hash);
     
     boost::lock_guard<DocumentCollection> guard{*docs_[coll]};
     
-    Document::Compare compare{id};
-    auto doc = docs_[coll]->find_fn(compare);
+    auto doc = docs_[coll]->find(id, hash);
     
     if (!doc) {
         throw DocumentMissing{};
@@ -102,30 +106,48 @@ document_ptr Documents::DeleteDocument(const char* id, const char* rev) {
     docCount_.fetch_sub(1, boost::memory_order_relaxed);
     dataSize_.fetch_sub(doc->getObject()->getSize(true), boost::memory_order_relaxed);
     
+    EraseViews(id);
+    
     return doc;
 }
 
 document_ptr Documents::SetDocument(const char* id, script_object_ptr obj) {
-    auto coll = GetDocumentCollectionIndex(id);
+    auto hash = Document::getIdHash(id);
+    auto coll = GetDocumentCollectionIndex(hash);
+    
+    // the posted revision is kept for the conflict check since preparing the object may set
+    // its new revision in place
+    auto postedRev = obj->getString("_rev", false);
+    const auto hasRev = postedRev != nullptr;
+    const std::string objRev = hasRev ? postedRev : "";
+    
+    // a revision which is already stale conflicts before the object is touched, so an object
+    // posted back from a stored document is either the current one, which is copied rather
+    // than changed in place, or has conflicted
+    auto currentDoc = docs_[coll]->find(id, hash);
+    if (!!currentDoc && (!hasRev || objRev != currentDoc->getRev())) {
+        throw DocumentConflict{};
+    }
     
-    boost::lock_guard<DocumentCollection> guard{*docs_[coll]};
+    // the new revision only depends on the posted document, so it is hashed before the lock
+    // is taken and the lock is only held to check the current revision and publish
+    auto newObj = Document::Prepare(id, obj, true, !!currentDoc && currentDoc->getObject() == obj);
     
-    Document::Compare compare{id};
-    auto oldDoc = docs_[coll]->find_fn(compare);
+    boost::lock_guard<DocumentCollection> guard{*docs_[coll]};
     
-    auto objRev = obj->getString("_rev", false);
+    auto oldDoc = docs_[coll]->find(id, hash);
 
     if (!!oldDoc) {
         auto docRev = oldDoc->getRev();
         
-        if (objRev == nullptr || std::strcmp(objRev, docRev) != 0) {
+        if (!hasRev || objRev != docRev) {
             throw DocumentConflict{};
         }
-    } else if (objRev != nullptr) {
-        DocumentRevision::Validate(objRev, true);
+    } else if (hasRev) {
+        DocumentRevision::Validate(objRev.c_str(), true);
     }
 
-    auto newDoc = Document::Create(id, obj, ++updateSeq_);
+    auto newDoc = Document::Create(newObj, ++updateSeq_);
 
     docs_[coll]->insert(newDoc);
     
@@ -136,6 +158,8 @@ document_ptr Documents::SetDocument(const char* id, script_object_ptr obj) {
     }
     
     dataSize_.fetch_add(newDoc->getObject()->getSize(true), boost::memory_order_relaxed);
+    
+    EraseViews(id);
 
     return newDoc;
 }
@@ -158,38 +182,6 @@ document_ptr Documents::SetDesignDocument(const char* id, script_object_ptr obj)
     return SetDocument(designId.c_str(), obj);
 }
 
-document_array_ptr Documents::GetDocuments(sequence_type& updateSequence) {
-    boost::unique_lock<decltype(allDocsCacheMtx_)> guard(allDocsCacheMtx_);
-    updateSequence = allDocsCacheUpdateSequence_;
-    
-    if (allDocsCacheUpdateSequence_ == updateSeq_) {
-        return allDocsCacheDocs_;
-    } else {
-        auto count = getCount();
-
-        auto allDocs = boost::make_shared<document_array>();
-        allDocs->reserve(count);
-        
-        updateSequence = updateSeq_;
-        allDocsCacheUpdateSequence_ = updateSequence;
-
-        for (unsigned i = 0; i < collections_; ++i) {
-            auto oldSize = allDocs->size();
-            boost::unique_lock<DocumentCollection> lock{*docs_[i]};
-            allDocs->insert(allDocs->end(), docs_[i]->cbegin(), docs_[i]->cend());
-            lock.unlock();
-            
-            if (i > 0) {
-                std::inplace_merge(allDocs->begin(), allDocs->begin() + oldSize, allDocs->end(), Document::Less{});
-            }
-        }
-
-        allDocsCacheDocs_ = allDocs;
-
-        return allDocs;
-    }
-}
-
 document_array_ptr Documents::GetDocuments(const GetAllDocumentsOptions& options, DocumentCollection::size_type& offset, DocumentCollection::size_type& totalDocs, sequence_type& updateSequence) {
     offset = 0;    
     totalDocs = 0;
@@ -199,68 +191,166 @@ document_array_ptr Documents::GetDocuments(const GetAllDocumentsOptions& options
     
     auto skip = options.Skip();
     auto limit = options.Limit();
+    const auto descending = options.Descending();
+    const auto maxLimit = std::numeric_limits<DocumentCollection::size_type>::max();
+    
+    auto before = [descending](const document_ptr& a, const document_ptr& b) { 
+        return descending ? Document::Less{}(b, a) : Document::Less{}(a, b); 
+    };
+    
+    // the range of ids in id order, whatever the direction
+    std::string startId;
+    std::string endId;
+    auto inclusiveStart = true;
+    auto inclusiveEnd = true;
+    if (!options.Key().empty()) {
+        startId = GetKeyId(options.Key());
+        endId = startId;
+    } else {
+        startId = GetKeyId(descending ? options.EndKey() : options.StartKey());
+        endId = GetKeyId(descending ? options.StartKey() : options.EndKey());
+        inclusiveStart = descending ? options.InclusiveEnd() : true;
+        inclusiveEnd = !descending ? options.InclusiveEnd() : true;
+    }
     
+    const auto count = skip + std::min(limit, maxLimit - skip);
+    
+    std::vector<document_array> filteredDocs(collections_);
+    
+    DocumentCollection::size_type filteredRows = 0;
     for (unsigned i = 0; i < collections_; ++i) {
-        boost::unique_lock<DocumentCollection> lock{*docs_[i]};
-        DocumentCollectionResults filteredResults{docs_[i], skip + std::min(limit, docs_[i]->size()), options.Key().c_str(),
-            options.StartKey().c_str(), options.EndKey().c_str(), options.InclusiveEnd(), options.Descending()};
-
-        if (i == 0) {
-            results->reserve(filteredResults.FilteredRows() * collections_);
+        // the range is sought in the last snapshot and in the writes since, which are
+        // overlaid so only the documents up to the skip and limit are touched
+        auto version = docs_[i]->version(startId.c_str(), inclusiveStart, endId.c_str(), inclusiveEnd, descending, count);
+        
+        DocumentCollectionResults docsResult{version.docs_, maxLimit, options.Key().c_str(),
+            options.StartKey().c_str(), options.EndKey().c_str(), options.InclusiveEnd(), descending};
+        
+        offset += docsResult.Offset() + version.offset_;
+        totalDocs += version.size_;
+        
+        auto& docs = filteredDocs[i];
+        if (!descending) {
+            OverlayDocuments(docsResult.cbegin(), docsResult.cend(), *version.added_, *version.erased_, before, count, docs);
+        } else {
+            using reverse_iterator = std::reverse_iterator<DocumentCollectionResults::const_iterator>;
+            OverlayDocuments(reverse_iterator{docsResult.cend()}, reverse_iterator{docsResult.cbegin()}, 
+                *version.added_, *version.erased_, before, count, docs);
         }
+        
+        filteredRows += docs.size();
+    }
+    
+    results->reserve(std::min(limit, filteredRows - std::min(skip, filteredRows)));
 
-        auto oldSize = results->size();
-        results->insert(results->end(), filteredResults.cbegin(), filteredResults.cend());        
-        offset += filteredResults.Offset();
-        totalDocs += filteredResults.TotalRows();
-        lock.unlock();
+    // the shards are merged in the requested direction and the merge stops once the
+    // skipped and limited documents have been found
+    using range = std::pair<document_array::const_iterator, document_array::const_iterator>;
+    
+    std::vector<range> ranges;
+    for (const auto& docs : filteredDocs) {
+        ranges.emplace_back(docs.cbegin(), docs.cend());
+    }
+    
+    offset += MergeDocuments(ranges, skip, limit, before, *results);
+    
+    return results;
+}
 
-        if (i > 0) {
-            std::inplace_merge(results->begin(), results->begin() + oldSize, results->end(), Document::Less{});
-        }
+std::string Documents::GetKeyId(const std::string& key) {
+    // the ids are given as json strings
+    if (key.size() > 1 && key.front() == '"' && key.back() == '"') {
+        return key.substr(1, key.size() - 2);
     }
+    
+    return key;
+}
 
-    // TODO: this should be optimized out
-    if (options.Descending()) {
-        results = boost::make_shared<document_array>(results->begin(), results->end());
-        std::reverse(results->begin(), results->end());
+template <typename Iter, typename Before>
+void Documents::OverlayDocuments(Iter docsIter, Iter docsEnd, const document_array& added, const document_array& erased, Before before, DocumentCollection::size_type count, document_array& results) {
+    // the writes are already in the requested direction
+    auto addedIter = added.cbegin();
+    auto addedEnd = added.cend();
+    auto erasedIter = erased.cbegin();
+    auto erasedEnd = erased.cend();
+    
+    while (results.size() < count && (docsIter != docsEnd || addedIter != addedEnd)) {
+        if (docsIter != docsEnd && (addedIter == addedEnd || before(*docsIter, *addedIter))) {
+            while (erasedIter != erasedEnd && before(*erasedIter, *docsIter)) {
+                ++erasedIter;
+            }
+            
+            if (erasedIter == erasedEnd || before(*docsIter, *erasedIter)) {
+                results.push_back(*docsIter);
+            }
+            
+            ++docsIter;
+        } else {
+            // a document written again replaces the one in the snapshot
+            if (docsIter != docsEnd && !before(*addedIter, *docsIter)) {
+                ++docsIter;
+            }
+            
+            results.push_back(*addedIter++);
+        }
     }
+}
+
+template <typename Iter, typename Before>
+DocumentCollection::size_type Documents::MergeDocuments(std::vector<std::pair<Iter, Iter>>& ranges, DocumentCollection::size_type skip, DocumentCollection::size_type limit, Before before, document_array& results) {
+    ranges.erase(std::remove_if(ranges.begin(), ranges.end(), [](const std::pair<Iter, Iter>& range) {
+        return range.first == range.second;
+    }), ranges.end());
     
-    // TODO: this should be optimized out
-    limit = std::min(limit, results->size());
-    if ((skip > 0 && skip < results->size()) || limit < results->size()) {
-        auto startIndex = std::min(skip, results->size());
-        auto endIndex = std::min(skip + limit, results->size());
-        results = boost::make_shared<document_array>(results->cbegin() + startIndex, results->cbegin() + endIndex);
-        offset += startIndex;
-    } else if (skip >= results->size()) {
-        offset += results->size();
-        results = boost::make_shared<document_array>();
+    // the range with the next document is kept at the top of the heap
+    auto compare = [&](const std::pair<Iter, Iter>& a, const std::pair<Iter, Iter>& b) {
+        return before(*b.first, *a.first);
+    };
+    
+    std::make_heap(ranges.begin(), ranges.end(), compare);
+    
+    DocumentCollection::size_type skipped = 0;
+    // the skipped documents are still counted when no documents are taken
+    while (!ranges.empty() && (skipped < skip || results.size() < limit)) {
+        std::pop_heap(ranges.begin(), ranges.end(), compare);
+        
+        auto& range = ranges.back();
+        if (skipped < skip) {
+            ++skipped;
+        } else {
+            results.push_back(*range.first);
+        }
+        
+        if (++range.first == range.second) {
+            ranges.pop_back();
+        } else {
+            std::push_heap(ranges.begin(), ranges.end(), compare);
+        }
     }
     
-    return results;
+    return skipped;
 }
 
 document_array_ptr Documents::PostDocuments(const PostAllDocumentsOptions& options, DocumentCollection::size_type& totalDocs, sequence_type& updateSequence) {
-    auto docs = GetDocuments(updateSequence);
+    updateSequence = updateSeq_;
+    totalDocs = getCount();
     
     const auto& keys = options.Keys();
     
     auto results = boost::make_shared<document_array>();
     results->reserve(keys.size());
     
-    for (auto key : keys) {
-        auto index = key.size() > 0 ? FindDocument(*docs, key, false) : FindMissedFlag;
-        if ((index & FindMissedFlag) == 0) {
-            auto doc = (*docs)[index];
-            results->emplace_back(doc);
-        } else {
-            results->emplace_back(nullptr);
+    // each key is a point lookup in the hash index of its collection, so writes
+    // don't leave anything to rebuild before the keys can be found
+    for (const auto& key : keys) {
+        document_ptr doc;
+        if (key.size() > 0) {
+            doc = GetDocument(GetKeyId(key).c_str(), false);
         }
+        
+        results->emplace_back(doc);
     }
     
-    totalDocs = docs->size();
-    
     if (options.Descending()) {
         std::reverse(results->begin(), results->end());
     }
@@ -282,7 +372,6 @@ document_array_ptr Documents::PostDocuments(const PostAllDocumentsOptions& optio
 }
 
 BulkDocumentsResults Documents::PostBulkDocuments(script_array_ptr docs, bool newEdits) {
-    BulkDocumentsResults results;
     UuidHelper::UuidGenerator gen;
     UuidHelper::UuidString newId;
     
@@ -296,6 +385,12 @@ BulkDocumentsResults Documents::PostBulkDocuments(script_array_ptr docs, bool ne
         }
     }
     
+    // the documents are grouped by collection, keeping their order within each group
+    // so repeated ids in the batch are applied in the order they were posted
+    std::vector<std::string> ids(size);
+    std::vector<std::uint64_t> hashes(size);
+    std::vector<std::vector<decltype(size)>> groups(collections_);
+    
     for (decltype(size) i = 0; i < size; ++i) {
         auto obj = docs->getObject(i);
         
@@ -306,35 +401,68 @@ BulkDocumentsResults Documents::PostBulkDocuments(script_array_ptr docs, bool ne
             id = newId;
         }
         
-        Document::Compare compare{id};
-        
-        auto objRev = obj->getString("_rev", false);
-        
-        auto coll = GetDocumentCollectionIndex(id);
+        ids[i] = id;
+        hashes[i] = Document::getIdHash(id);
+        groups[GetDocumentCollectionIndex(hashes[i])].push_back(i);
+    }
+    
+    std::vector<boost::optional<BulkDocumentsResult>> orderedResults(size);
     
-        boost::unique_lock<DocumentCollection> lock{*docs_[coll]};                
-        auto oldDoc = docs_[coll]->find_fn(compare);                
+    auto postGroup = [&](unsigned coll) {
+        const auto& group = groups[coll];
         
-        const char* error = nullptr;
-        const char* reason = nullptr;
-        if (!!oldDoc && newEdits) {                     
-            auto docRev = oldDoc->getRev();
-
-            if (objRev == nullptr || std::strcmp(objRev, docRev) != 0) {
-                error = "conflict";
-                reason = "Document update conflict.";
+        // the group's revisions are hashed before the lock is taken, keeping the posted
+        // revisions for the conflict checks
+        std::vector<script_object_ptr> newObjs;
+        std::vector<boost::optional<std::string>> objRevs;
+        newObjs.reserve(group.size());
+        objRevs.reserve(group.size());
+        
+        for (auto i : group) {
+            auto obj = docs->getObject(i);
+            auto postedRev = obj->getString("_rev", false);
+            objRevs.emplace_back();
+            if (postedRev != nullptr) {
+                objRevs.back() = std::string{postedRev};
+            }
+            
+            // as for a single document a stale revision conflicts before the object is touched
+            auto currentDoc = docs_[coll]->find(ids[i].c_str(), hashes[i]);
+            if (!!currentDoc && newEdits && (!objRevs.back() || *objRevs.back() != currentDoc->getRev())) {
+                orderedResults[i].emplace(ids[i].c_str(), "conflict", "Document update conflict.");
+                newObjs.emplace_back();
+            } else {
+                newObjs.emplace_back(Document::Prepare(ids[i].c_str(), obj, newEdits, !!currentDoc && currentDoc->getObject() == obj));
             }
         }
         
-        if (!error) {
-            auto newDoc = Document::Create(id, obj, ++updateSeq_, newEdits);
+        boost::unique_lock<DocumentCollection> lock{*docs_[coll]};
+        
+        for (decltype(group.size()) j = 0; j < group.size(); ++j) {
+            if (!newObjs[j]) {
+                continue;
+            }
+            
+            auto i = group[j];
+            auto id = ids[i].c_str();
+            const auto& objRev = objRevs[j];
+            
+            auto oldDoc = docs_[coll]->find(id, hashes[i]);
+            
+            if (!!oldDoc && newEdits) {
+                auto docRev = oldDoc->getRev();
 
-            docs_[coll]->insert(newDoc);
+                if (!objRev || *objRev != docRev) {
+                    orderedResults[i].emplace(id, "conflict", "Document update conflict.");
+                    continue;
+                }
+            }
             
-            lock.unlock();
+            auto newDoc = Document::Create(newObjs[j], ++updateSeq_);
 
-            auto newRev = newDoc->getRev();
-            results.emplace_back(id, newRev);
+            docs_[coll]->insert(newDoc);
+            
+            orderedResults[i].emplace(id, newDoc->getRev());
 
             if (!oldDoc) {
                 docCount_.fetch_add(1, boost::memory_order_relaxed);
@@ -343,19 +471,46 @@ BulkDocumentsResults Documents::PostBulkDocuments(script_array_ptr docs, bool ne
             }
             
             dataSize_.fetch_add(newDoc->getObject()->getSize(true), boost::memory_order_relaxed);
-        } else {
-            results.emplace_back(id, error, reason);
-        }     
+        }
+    };
+    
+    // each collection is locked once for its group, with the groups posted in parallel
+    // and the calling thread taking any group which a writer thread hasn't started yet
+    auto usedGroups = std::count_if(groups.cbegin(), groups.cend(), [](const std::vector<decltype(size)>& group) { return group.size() > 0; });
+    
+    if (usedGroups > 1) {
+        auto& threadPool = GetWriteThreadPool();
+        MapReduceTaskGroup tasks{[&threadPool](const MapReduceTaskGroup::task_function& task) { threadPool.post(task); }, true};
+        for (unsigned coll = 0; coll < collections_; ++coll) {
+            if (groups[coll].size() > 0) {
+                tasks.Run([&, coll]() { postGroup(coll); });
+            }
+        }
+        
+        tasks.Wait();
+    } else {
+        for (unsigned coll = 0; coll < collections_; ++coll) {
+            if (groups[coll].size() > 0) {
+                postGroup(coll);
+            }
+        }
+    }
+    
+    BulkDocumentsResults results;
+    results.reserve(size);
+    for (auto& result : orderedResults) {
+        if (result->ok_) {
+            EraseViews(result->id_.c_str());
+        }
+        
+        results.emplace_back(*result);
     }
     
     return results;
 }
 
 document_ptr Documents::GetLocalDocument(const char* id) {
-    boost::lock_guard<DocumentCollection> guard{*localDocs_};
-    
-    Document::Compare compare{id};
-    auto doc = localDocs_->find_fn(compare);
+    auto doc = localDocs_->find(id);
     
     if (!doc) {
         throw DocumentMissing{};
@@ -367,8 +522,7 @@ document_ptr Documents::GetLocalDocument(const char* id) {
 document_ptr Documents::SetLocalDocument(const char* id, script_object_ptr obj) {
     boost::lock_guard<DocumentCollection> guard{*localDocs_};
     
-    Document::Compare compare{id};
-    auto doc = localDocs_->find_fn(compare);
+    auto doc = localDocs_->find(id);
     
     const char* objRev = obj->getString("_rev", false);
 
@@ -392,8 +546,7 @@ document_ptr Documents::SetLocalDocument(const char* id, script_object_ptr obj)
 document_ptr Documents::DeleteLocalDocument(const char* id, const char* rev) {
     boost::lock_guard<DocumentCollection> guard{*localDocs_};
     
-    Document::Compare compare{id};
-    auto doc = localDocs_->find_fn(compare);
+    auto doc = localDocs_->find(id);
     
     if (!doc) {
         throw DocumentMissing{};
@@ -412,65 +565,183 @@ document_ptr Documents::DeleteLocalDocument(const char* id, const char* rev) {
 }
 
 map_reduce_results_ptr Documents::PostTempView(const GetViewOptions& options, rs::scriptobject::ScriptObjectPtr obj) {        
-    document_collections_ptr_array colls{docs_.cbegin(), docs_.cend()};
+    sequence_type updateSequence = updateSeq_;
     
     auto task = MapReduce::MapReduceTask::Create(obj);
     
-    auto results = mapReduce_.Execute(options, task, colls);    
+    std::string source = task.Language();
+    source += '\0';
+    source += task.Map();
+    source += '\0';
+    source += task.Reduce();
+    auto hash = CityHash64(source.data(), source.size());
+    
+    // the sorted map rows of each shard are cached so different slices of the same view are cheap
+    auto mapResults = GetTempViewCacheResults(hash, source, updateSequence);
+    if (mapResults.empty()) {
+        document_collections_ptr_array colls{docs_.cbegin(), docs_.cend()};
+        mapResults = mapReduce_.Map(task, colls);
+        SetTempViewCacheResults(hash, source, updateSequence, mapResults);
+    }
+    
+    auto results = mapReduce_.Execute(options, task, mapResults);
     return results;
 }
 
-DocumentCollection::size_type Documents::FindDocument(const document_array& docs, const std::string& key, bool descending) {
-    const auto size = docs.size();
+std::vector<map_reduce_result_array_ptr> Documents::GetTempViewCacheResults(std::uint64_t hash, const std::string& source, sequence_type updateSequence) {
+    boost::lock_guard<boost::mutex> guard{tempViewCacheMtx_};
     
-    if (size == 0) {
-        return ~0;
-    } else {
-        const char* keyId = key.c_str();
-        auto keyIdLength = key.size();
-        if (keyId[0] == '"' && keyId[keyIdLength - 1] == '"') {
-            keyId++;
-            keyIdLength -= 2;
+    std::vector<map_reduce_result_array_ptr> results;
+    for (auto iter = tempViewCache_.begin(); iter != tempViewCache_.end();) {
+        if (iter->updateSeq_ != updateSequence) {
+            iter = tempViewCache_.erase(iter);
+        } else if (iter->hash_ == hash && iter->source_ == source) {
+            results = iter->results_;
+            tempViewCache_.splice(tempViewCache_.begin(), tempViewCache_, iter++);
+        } else {
+            ++iter;
         }
-        
-        DocumentCollection::size_type min = 0;
-        DocumentCollection::size_type mid = 0;
-        DocumentCollection::size_type max = size - 1;
+    }
+    
+    return results;
+}
 
-        while (min <= max) {
-            mid = ((max - min) / 2) + min;
+void Documents::SetTempViewCacheResults(std::uint64_t hash, const std::string& source, sequence_type updateSequence, const std::vector<map_reduce_result_array_ptr>& results) {
+    std::size_t resultRows = 0;
+    for (const auto& result : results) {
+        resultRows += result->size();
+    }
+    
+    const auto maxRows = Config::MapReduce::GetTempViewCacheSize();
+    if (resultRows > maxRows || updateSequence != updateSeq_) {
+        return;
+    }
+    
+    boost::lock_guard<boost::mutex> guard{tempViewCacheMtx_};
+    
+    for (auto iter = tempViewCache_.begin(); iter != tempViewCache_.end();) {
+        if (iter->updateSeq_ != updateSequence || (iter->hash_ == hash && iter->source_ == source)) {
+            iter = tempViewCache_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    
+    tempViewCache_.emplace_front(TempViewCacheEntry{hash, source, updateSequence, results, resultRows});
+    
+    // the least recently used entries are dropped to bound the rows held by the cache
+    std::size_t rows = 0;
+    for (auto iter = tempViewCache_.begin(); iter != tempViewCache_.end();) {
+        rows += iter->rows_;
+        if (rows > maxRows) {
+            iter = tempViewCache_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
 
-            auto docId = docs[mid]->getId();
-            auto diff = std::strncmp(keyId, docId, keyIdLength);
-            if (diff == 0 && docId[keyIdLength] != '\0') {
-                diff = -1;
-            }
+map_reduce_results_ptr Documents::GetDesignDocumentView(const GetViewOptions& options, const char* designId, const char* viewId) {
+    // read the sequence before the view so the next read picks up any concurrent updates
+    sequence_type updateSequence = updateSeq_;
+    
+    auto view = GetView(designId, viewId);
+    document_collections_ptr_array colls{docs_.cbegin(), docs_.cend()};
+    
+    auto results = mapReduce_.Execute(options, view, colls, updateSequence);
+    return results;
+}
 
-            diff = descending ? -diff : diff;
-            if (diff == 0) {
-                return mid;
-            } else if (diff < 0) {
-                if (mid == 0) {
-                    break;
-                }
-                
-                max = mid - 1;
-            } else {
-                min = mid + 1;
-            }
+map_reduce_view_ptr Documents::GetView(const char* designId, const char* viewId) {
+    auto designDoc = GetDesignDocument(designId, false);
+    if (!designDoc) {
+        std::string id = "_design/";
+        id += designId;
+        EraseViews(id.c_str());
+        
+        throw DocumentMissing{};
+    }
+    
+    std::string key = designDoc->getId();
+    key += '/';
+    key += viewId;
+    
+    boost::lock_guard<boost::mutex> guard{viewsMtx_};
+    
+    // a view is rebuilt from scratch whenever its design document changes
+    auto iter = views_.find(key);
+    if (iter != views_.end()) {
+        if (iter->second->DesignDocument() == designDoc) {
+            return iter->second;
         }
+        
+        views_.erase(iter);
+    }
+    
+    auto designObj = designDoc->getObject();
+    if (designObj->getType("views") != rs::scriptobject::ScriptObjectType::Object) {
+        throw ViewMissing{};
+    }
+    
+    auto viewsObj = designObj->getObject("views");
+    if (viewsObj->getType(viewId) != rs::scriptobject::ScriptObjectType::Object) {
+        throw ViewMissing{};
+    }
+    
+    auto viewObj = viewsObj->getObject(viewId);
+    if (viewObj->getType("map") != rs::scriptobject::ScriptObjectType::String) {
+        throw ViewMissing{};
+    }
+    
+    auto task = MapReduce::MapReduceTask::Create(viewObj, designObj->getString("language", false));
+    auto view = MapReduceView::Create(designDoc, task, collections_);
+    views_[key] = view;
+    
+    return view;
+}
 
-        return ~min;
+void Documents::EraseViews(const char* id) {
+    if (std::strncmp(id, "_design/", 8) != 0) {
+        return;
+    }
+    
+    // the views of a design document which has been written or deleted are dropped so
+    // their shards are released, rather than waiting for the view to be read again
+    std::string prefix = id;
+    prefix += '/';
+    
+    boost::lock_guard<boost::mutex> guard{viewsMtx_};
+    for (auto iter = views_.begin(); iter != views_.end();) {
+        if (iter->first.compare(0, prefix.size(), prefix) == 0) {
+            iter = views_.erase(iter);
+        } else {
+            ++iter;
+        }
     }
 }
 
+ThreadPool& Documents::GetWriteThreadPool() {
+    // the writes have their own threads, so they don't depend on the map/reduce pool being
+    // started and don't queue behind the queries running on it
+    static ThreadPool threadPool{[]() {
+        ThreadPoolOptions threadPoolOptions;
+        threadPoolOptions.threads_count = Config::GetCPUCount();
+        threadPoolOptions.onStart = [](size_t) { 
+            SetThreadName::Set("DocumentsWriter"); 
+        };
+        
+        return threadPoolOptions;
+    }()};
+    
+    return threadPool;
+}
+
 unsigned Documents::GetCollectionCount() const {
     auto collections = Config::GetCPUCount() * 2;           
     return collections;
 }
 
-unsigned Documents::GetDocumentCollectionIndex(const char* id) const {
-    auto hash = Document::getIdHash(id);
+unsigned Documents::GetDocumentCollectionIndex(std::uint64_t hash) const {
     auto index = hash % collections_;   
     return index;
 }
\ No newline at end of file
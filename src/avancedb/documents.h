@@ -21,6 +21,10 @@
 
 #include <limits>
 #include <vector>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 #include <boost/noncopyable.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -39,6 +43,8 @@
 #include "map_reduce.h"
 
 class Database;
+class DocumentCollectionResults;
+class ThreadPool;
 
 class Documents final : public boost::enable_shared_from_this<Documents>, private boost::noncopyable {
 public:        
@@ -63,6 +69,7 @@ public:
     BulkDocumentsResults PostBulkDocuments(script_array_ptr docs, bool newEdits);
     
     map_reduce_results_ptr PostTempView(const GetViewOptions& options, rs::scriptobject::ScriptObjectPtr obj);
+    map_reduce_results_ptr GetDesignDocumentView(const GetViewOptions& options, const char* designId, const char* viewId);
     
     DocumentCollection::size_type getCount();
     std::uint64_t getDataSize();
@@ -72,8 +79,6 @@ private:
     
     friend documents_ptr boost::make_shared<documents_ptr::element_type>(database_ptr&);
     
-    const DocumentCollection::size_type FindMissedFlag = ~(std::numeric_limits<DocumentCollection::size_type>::max() / 2);
-    
     class DocumentsMutex {
     public:
         DocumentsMutex() {}
@@ -89,12 +94,33 @@ private:
         char padding_[64];
     };
     
+    struct TempViewCacheEntry final {
+        std::uint64_t hash_;
+        std::string source_;
+        sequence_type updateSeq_;
+        std::vector<map_reduce_result_array_ptr> results_;
+        std::size_t rows_;
+    };
+    
     Documents(database_ptr db);
     
-    document_array_ptr GetDocuments(sequence_type& updateSequence);
-    DocumentCollection::size_type FindDocument(const document_array& docs, const std::string& key, bool descending);
     unsigned GetCollectionCount() const;
-    unsigned GetDocumentCollectionIndex(const char* id) const;
+    
+    // overlays the writes since the snapshot on its range until count documents have been taken
+    template <typename Iter, typename Before>
+    static void OverlayDocuments(Iter docsIter, Iter docsEnd, const document_array& added, const document_array& erased, Before before, DocumentCollection::size_type count, document_array& results);
+    // merges the sorted ranges until limit documents have been taken after skipping skip documents,
+    // returns the number of documents skipped
+    template <typename Iter, typename Before>
+    static DocumentCollection::size_type MergeDocuments(std::vector<std::pair<Iter, Iter>>& ranges, DocumentCollection::size_type skip, DocumentCollection::size_type limit, Before before, document_array& results);
+    // strips the quotes from a key given as a json string
+    static std::string GetKeyId(const std::string& key);
+    unsigned GetDocumentCollectionIndex(std::uint64_t hash) const;
+    map_reduce_view_ptr GetView(const char* designId, const char* viewId);
+    void EraseViews(const char* id);
+    static ThreadPool& GetWriteThreadPool();
+    std::vector<map_reduce_result_array_ptr> GetTempViewCacheResults(std::uint64_t hash, const std::string& source, sequence_type updateSequence);
+    void SetTempViewCacheResults(std::uint64_t hash, const std::string& source, sequence_type updateSequence, const std::vector<map_reduce_result_array_ptr>& results);
     
     database_wptr db_;
     
@@ -107,9 +133,11 @@ private:
     document_collection_ptr localDocs_;
     boost::atomic<sequence_type> localUpdateSeq_;
     
-    boost::mutex allDocsCacheMtx_;
-    boost::atomic<sequence_type> allDocsCacheUpdateSequence_;
-    document_array_ptr allDocsCacheDocs_;
+    boost::mutex viewsMtx_;
+    std::unordered_map<std::string, map_reduce_view_ptr> views_;
+    
+    boost::mutex tempViewCacheMtx_;
+    std::list<TempViewCacheEntry> tempViewCache_;
 
     MapReduce mapReduce_;
 };
@@ -17,13 +17,26 @@
  */
 #include "get_view_options.h"
 
+#include <vector>
+
+#include "script_array_json_source.h"
+#include "script_array_factory.h"
+
+#include "rest_exceptions.h"
+
 GetViewOptions::GetViewOptions(const rs::httpserver::QueryString& qs) : GetAllDocumentsOptions(qs) {
     
 }
 
+GetViewOptions::GetViewOptions(const rs::httpserver::QueryString& qs, script_array_ptr keys) : GetAllDocumentsOptions(qs) {
+    if (!!keys) {
+        keys_ = keys;
+    }
+}
+
 bool GetViewOptions::Reduce() const {
     if (!reduce_.is_initialized()) {
-        reduce_ = GetBoolean("reduce", false);
+        reduce_ = GetBoolean("reduce", true);
     }
     return reduce_.get();
 }
@@ -64,4 +77,28 @@ map_reduce_query_key_ptr GetViewOptions::EndKeyObj() const {
     }
     
     return ptr;
-}
\ No newline at end of file
+}
+
+script_array_ptr GetViewOptions::Keys() const {
+    if (!keys_.is_initialized()) {
+        script_array_ptr keys{nullptr};
+        
+        auto json = GetString("keys");
+        if (json.size() > 0) {
+            // the json source parses the buffer in place
+            std::vector<char> buffer{json.cbegin(), json.cend()};
+            buffer.push_back('\0');
+            
+            try {
+                rs::scriptobject::ScriptArrayJsonSource source{buffer.data()};
+                keys = rs::scriptobject::ScriptArrayFactory::CreateArray(source);
+            } catch (const std::exception&) {
+                throw QueryParseError{"keys", json};
+            }
+        }
+        
+        keys_ = keys;
+    }
+    
+    return keys_.get();
+}
@@ -25,6 +25,7 @@
 class GetViewOptions final : public GetAllDocumentsOptions  {
 public:
     GetViewOptions(const rs::httpserver::QueryString& qs);
+    GetViewOptions(const rs::httpserver::QueryString& qs, script_array_ptr keys);
     
     bool Reduce() const;
     bool Group() const;    
@@ -33,11 +34,15 @@ public:
     map_reduce_query_key_ptr StartKeyObj() const;
     map_reduce_query_key_ptr EndKeyObj() const;
     
+    // the keys posted in the body or passed in the keys parameter, or null for a key range
+    script_array_ptr Keys() const;
+    
 private:
 
     mutable boost::optional<bool> reduce_;
     mutable boost::optional<bool> group_;
     mutable boost::optional<uint64_t> groupLevel_;
+    mutable boost::optional<script_array_ptr> keys_;
 };
 
 #endif	/* GET_VIEW_OPTIONS_H */
@@ -21,14 +21,18 @@
 #include <boost/make_shared.hpp>
 #include <boost/scope_exit.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/optional.hpp>
 
 #include <memory>
 #include <algorithm>
-#include <condition_variable>
 #include <functional>
+#include <exception>
+#include <iterator>
 
 #include "script_array_jsapi_key_value_source.h"
 #include "map_reduce_result.h"
+#include "map_reduce_result_arena.h"
+#include "map_reduce_view.h"
 #include "map_reduce_shard_results.h"
 #include "script_object_jsapi_source.h"
 #include "script_array_jsapi_source.h"
@@ -37,28 +41,119 @@
 #include "config.h"
 #include "set_thread_name.h"
 #include "map_reduce_thread_pool.h"
+#include "map_reduce_task_group.h"
+#include "map_reduce_function_cache.h"
+#include "map_reduce_native_reducer.h"
+#include "map_reduce_native_map.h"
+#include "map_reduce_result_comparers.h"
+#include "map_reduce_cancellation.h"
 #include "rest_exceptions.h"
-#include "map_reduce_exception.h"
 
 #include "script_object_factory.h"
 #include "script_array_factory.h"
+#include "script_array_vector_source.h"
 
-MapReduce::MapReduce() : mapReduceThreadPool_(MapReduceThreadPool::Get()) {
+MapReduce::MapReduce() : MapReduce(Config::MapReduce::GetMapBatchSize()) {
+    
+}
+
+MapReduce::MapReduce(unsigned mapBatchSize) : MapReduce(mapBatchSize, Config::MapReduce::GetMapRangeSize()) {
+    
+}
+
+MapReduce::MapReduce(unsigned mapBatchSize, unsigned mapRangeSize) : 
+        mapReduceThreadPool_(MapReduceThreadPool::Get()), mapBatchSize_(mapBatchSize), mapRangeSize_(std::max(1u, mapRangeSize)) {
     
 }
 
 map_reduce_results_ptr MapReduce::Execute(const GetViewOptions& options, const MapReduceTask& task, document_collections_ptr_array colls) {
+    ValidateLanguage(task);
+    
+    auto shardResults = Map(colls, [&](rs::jsapi::Runtime& rt, const document_collection_ptr& coll, unsigned) {
+        auto docs = coll->snapshot();
+        return Execute(rt, task, docs);
+    });
+    
+    return IsReduce(options, task) ? Reduce(options, task, shardResults) : Merge(options, shardResults);
+}
+
+map_reduce_results_ptr MapReduce::Execute(const GetViewOptions& options, map_reduce_view_ptr view, document_collections_ptr_array colls, sequence_type updateSequence) {
+    const auto& task = view->Task();
+    ValidateLanguage(task);
+    
+    boost::unique_lock<map_reduce_view_ptr::element_type> viewLock{*view};
+    
+    // only the documents which have changed since the view was last read are mapped
+    if (view->UpdateSequence() != updateSequence) {
+        Map(colls, [&](rs::jsapi::Runtime& rt, const document_collection_ptr& coll, unsigned index) {
+            view->Refresh(index, coll, [&](const document_array_ptr& docs) { return Execute(rt, task, docs); });
+            return map_reduce_result_array_ptr{};
+        });
+        
+        view->SetUpdateSequence(updateSequence);
+    }
+    
+    auto shardResults = view->Shards();
+    viewLock.unlock();
+    
+    return IsReduce(options, task) ? Reduce(options, task, shardResults) : Merge(options, shardResults);
+}
+
+map_reduce_result_array_ptr MapReduce::Execute(const MapReduceTask& task, document_collections_ptr_array colls) {
+    auto shardResults = Map(task, colls);
+    
+    std::vector<map_reduce_shard_results_ptr> filteredResults;
+    filteredResults.reserve(shardResults.size());
+    for (const auto& result : shardResults) {
+        filteredResults.emplace_back(boost::make_shared<map_reduce_shard_results_ptr::element_type>(
+            result, result->size(), nullptr, nullptr, true, false));
+    }
+    
+    return Merge(filteredResults);
+}
+
+std::vector<map_reduce_result_array_ptr> MapReduce::Map(const MapReduceTask& task, document_collections_ptr_array colls) {
+    ValidateLanguage(task);
+    
+    return Map(colls, [&](rs::jsapi::Runtime& rt, const document_collection_ptr& coll, unsigned) {
+        auto docs = coll->snapshot();
+        return Execute(rt, task, docs);
+    });
+}
+
+map_reduce_results_ptr MapReduce::Execute(const GetViewOptions& options, const MapReduceTask& task, const std::vector<map_reduce_result_array_ptr>& shardResults) {
+    return IsReduce(options, task) ? Reduce(options, task, shardResults) : Merge(options, shardResults);
+}
+
+void MapReduce::ValidateLanguage(const MapReduceTask& task) {
+    // a native map has already been parsed by the task so its errors are reported before the map starts
     auto language = task.Language();
-    if (!boost::iequals("javascript", language)) {
+    if (!task.NativeMap() && !boost::iequals("javascript", language)) {
         throw BadLanguageError{language};
     }
-    
-    std::mutex m;
+}
+
+bool MapReduce::IsReduce(const GetViewOptions& options, const MapReduceTask& task) {
+    return options.Reduce() && task.Reduce()[0] != '\0';
+}
+
+std::vector<map_reduce_result_array_ptr> MapReduce::Map(const document_collections_ptr_array& colls, const shard_map_function& map) {
     auto collsSize = colls.size();
-    std::vector<map_reduce_shard_results_ptr> filteredResults;
-    std::vector<rs::jsapi::ScriptException> scriptExceptions;
-    std::atomic<int> threads(collsSize);
-    std::condition_variable threadEnd;
+    std::vector<map_reduce_result_array_ptr> shardResults(collsSize);
+    
+    // the map needs the runtime of the pool thread it runs on
+    ExecuteTasks(collsSize, false, [&](std::size_t i) {
+        auto& rt = mapReduceThreadPool_->GetThreadRuntime();
+        shardResults[i] = map(rt, colls[i], i);
+    });
+    
+    return shardResults;
+}
+
+map_reduce_results_ptr MapReduce::Merge(const GetViewOptions& options, const std::vector<map_reduce_result_array_ptr>& shardResults) {
+    if (!!options.Keys()) {
+        return MergeKeys(options, shardResults);
+    }
     
     const auto skip = options.Skip();
     const auto limit = options.Limit();
@@ -67,62 +162,110 @@ map_reduce_results_ptr MapReduce::Execute(const GetViewOptions& options, const M
     const auto inclusiveEnd = options.InclusiveEnd();
     const auto descending = options.Descending();
     
-    // run the map
-    for (auto& coll : colls) {
-        mapReduceThreadPool_->Post([&]() {
-            std::unique_lock<std::mutex> lock{m, std::defer_lock};
-            
-            try {
-                BOOST_SCOPE_EXIT(&threads) { --threads; } BOOST_SCOPE_EXIT_END
-                auto& rt = mapReduceThreadPool_->GetThreadRuntime();
-                
-                boost::unique_lock<document_collections_ptr_array::value_type::element_type> collLock{*coll};                
-                document_array docs;
-                coll->copy(docs, false);
-                collLock.unlock();
-                
-                auto result = Execute(rt, task, docs);                                
-                
-                auto filteredResult = boost::make_shared<map_reduce_shard_results_ptr::element_type>(
-                    result, skip + std::min(limit, result->size()), startKey, endKey, inclusiveEnd, descending);               
-
-                lock.lock();
-                filteredResults.emplace_back(filteredResult);
-                threadEnd.notify_one();
-            } catch (const rs::jsapi::ScriptException& ex) {
-                lock.lock();
-                threadEnd.notify_one();
-                scriptExceptions.emplace_back(ex);
-            }
-        });
+    std::vector<map_reduce_shard_results_ptr> filteredResults;
+    filteredResults.reserve(shardResults.size());
+    for (const auto& result : shardResults) {
+        filteredResults.emplace_back(boost::make_shared<map_reduce_shard_results_ptr::element_type>(
+            result, skip + std::min(limit, result->size()), startKey, endKey, inclusiveEnd, descending));
+    }
+    
+    // calculate the number of map rows and offsets
+    decltype(filteredResults.size()) totalRows = 0;
+    decltype(filteredResults.size()) offset = 0;
+    decltype(filteredResults.size()) filteredRows = 0;
+    for (const auto& result : filteredResults) {
+        totalRows += result->TotalRows();
+        offset += result->Offset();
+        filteredRows += result->FilteredRows();
     }
     
-    // wait for the map threads to finish
-    std::unique_lock<std::mutex> lock{m};
-    threadEnd.wait(lock, [&]() { return threads.load() == 0; });
+    // the skip and limit are clamped to the filtered rows here so the offset doesn't depend
+    // on whether the rows have been read, the shards are merged while the rows are read
+    // so nothing is copied before the first row
+    const auto filteredSkip = std::min(skip, filteredRows);
+    const auto filteredLimit = std::min(limit, filteredRows - filteredSkip);
+    return boost::make_shared<map_reduce_results_ptr::element_type>(std::move(filteredResults), offset, totalRows, filteredSkip, filteredLimit, descending);
+}
+
+map_reduce_results_ptr MapReduce::MergeKeys(const GetViewOptions& options, const std::vector<map_reduce_result_array_ptr>& shardResults) {
+    const auto skip = options.Skip();
+    const auto limit = options.Limit();
+    const auto descending = options.Descending();
+    
+    std::vector<std::string> keys;
+    std::vector<std::string> sortedKeys;
+    EncodeKeys(options.Keys(), keys, sortedKeys);
     
-    // we need to pass back any script exceptions to the caller
-    if (scriptExceptions.size() > 0) {
-        auto what = scriptExceptions[0].what();
-        throw CompilationError{what};
+    auto shardRanges = FindKeys(shardResults, sortedKeys);
+    
+    auto results = boost::make_shared<map_reduce_result_array_ptr::element_type>();
+    
+    decltype(results->size()) totalRows = 0;
+    for (const auto& result : shardResults) {
+        totalRows += result->size();
+        results->add_source(result);
     }
     
-    // if the number of results doesn't match the number of colls then
-    // we've most likely got a non-script exception during the map phase
-    if (filteredResults.size() != colls.size()) {
-        throw MapReduceException{};
+    // the rows are returned in the order of the requested keys, the rows of each key in id order
+    std::vector<map_reduce_result_ptr> keyRows;
+    for (const auto& key : keys) {
+        auto index = std::distance(sortedKeys.cbegin(), std::lower_bound(sortedKeys.cbegin(), sortedKeys.cend(), key));
+        
+        keyRows.clear();
+        for (const auto& ranges : shardRanges) {
+            keyRows.insert(keyRows.end(), ranges[index].first, ranges[index].second);
+        }
+        
+        std::sort(keyRows.begin(), keyRows.end(), [](const map_reduce_result_ptr& a, const map_reduce_result_ptr& b) {
+            return MapReduceResult::Less(a, b);
+        });
+        
+        if (descending) {
+            std::reverse(keyRows.begin(), keyRows.end());
+        }
+        
+        for (const auto& row : keyRows) {
+            results->push_back(row);
+        }
     }
     
-    // calculate the number of map rows and offsets
+    return boost::make_shared<map_reduce_results_ptr::element_type>(results, 0, totalRows, skip, limit, false);
+}
+
+std::vector<std::vector<MapReduce::key_range_type>> MapReduce::FindKeys(const std::vector<map_reduce_result_array_ptr>& shardResults, const std::vector<std::string>& sortedKeys) {
+    std::vector<std::vector<key_range_type>> shardRanges(shardResults.size());
+    
+    // each shard searches for all of the keys at once
+    ExecuteTasks(shardResults.size(), true, [&](std::size_t i) {
+        shardRanges[i] = MapReduceShardResults::FindKeys(*shardResults[i], sortedKeys);
+    });
+    
+    return shardRanges;
+}
+
+void MapReduce::EncodeKeys(const script_array_ptr& keys, std::vector<std::string>& encodedKeys, std::vector<std::string>& sortedKeys) {
+    encodedKeys.resize(keys->getCount());
+    for (decltype(keys->getCount()) i = 0, count = keys->getCount(); i < count; ++i) {
+        MapReduceResultComparers::AppendCollationKey(encodedKeys[i], keys, i);
+    }
+    
+    sortedKeys = encodedKeys;
+    std::sort(sortedKeys.begin(), sortedKeys.end());
+    sortedKeys.erase(std::unique(sortedKeys.begin(), sortedKeys.end()), sortedKeys.end());
+}
+
+int MapReduce::CompareKey(const map_reduce_result_ptr& result, const std::string& key) {
+    return MapReduceResult::CompareCollationKeys(result->getCollationKey(), result->getCollationKeySize(), key.data(), key.size());
+}
+
+map_reduce_result_array_ptr MapReduce::Merge(const std::vector<map_reduce_shard_results_ptr>& filteredResults) {
+    auto collsSize = filteredResults.size();
+    
     decltype(filteredResults.size()) filteredRows = 0;
-    decltype(filteredResults.size()) totalRows = 0;
-    decltype(filteredResults.size()) offset = 0;
     std::vector<decltype(filteredRows)> filteredRowOffsets;
     for (const auto& result : filteredResults) {
         filteredRowOffsets.emplace_back(filteredRows);
         filteredRows += result->FilteredRows();
-        totalRows += result->TotalRows();
-        offset += result->Offset();
     }
     filteredRowOffsets.emplace_back(filteredRows);
     
@@ -140,8 +283,6 @@ map_reduce_results_ptr MapReduce::Execute(const GetViewOptions& options, const M
     };
     
     auto mergeResultsWorker = [&](decltype(collsSize) startIndex, decltype(collsSize) step) {
-        BOOST_SCOPE_EXIT(&threads) { --threads; } BOOST_SCOPE_EXIT_END
-        
         auto midStep = step / 2;
         auto midIndex = startIndex + midStep;
         auto endIndex = std::min(startIndex + step, collsSize);
@@ -154,92 +295,471 @@ map_reduce_results_ptr MapReduce::Execute(const GetViewOptions& options, const M
         std::inplace_merge(begin + startOffset, begin + midOffset, begin + endOffset, less);
     };
 
-    // merge the result shards on the main results collection
-    decltype(collsSize) step = 2;
+    // merge pairs of neighbouring ranges until a single sorted range is left, each
+    // level waits for the previous one and the caller helps with the merging
     const auto useThreadsForMerge = filteredRows >= 10000;
-    while ((threads = collsSize / step) > 0) {
+    for (decltype(collsSize) step = 2; step / 2 < collsSize; step *= 2) {
+        MapReduceCancellation::CheckCurrent();
+        
+        MapReduceTaskGroup mergeTasks{*mapReduceThreadPool_, true};
         
-        for (decltype(collsSize) i = 0; i <= collsSize - step; i += step) {
+        for (decltype(collsSize) i = 0; i + step / 2 < collsSize; i += step) {
             if (useThreadsForMerge) {
-                mapReduceThreadPool_->Post([=]() { mergeResultsWorker(i, step); });
+                mergeTasks.Run([=]() { mergeResultsWorker(i, step); });
             } else {
                 mergeResultsWorker(i, step);
             }
         }
         
-        // wait for the merge threads to finish
-        while (threads.load() > 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        }
+        mergeTasks.Wait();
+    }
+    
+    return results;
+}
 
-        step *= 2;
+map_reduce_results_ptr MapReduce::Reduce(const GetViewOptions& options, const MapReduceTask& task, const std::vector<map_reduce_result_array_ptr>& shardResults) {
+    const auto reduce = task.Reduce();
+    
+    boost::optional<MapReduceNativeReducer> reducer;
+    if (MapReduceNativeReducer::IsNative(reduce)) {
+        reducer = MapReduceNativeReducer::Create(reduce);
     }
     
-    // if we had an odd number of collections then there is one left to merge
-    if ((collsSize % step) > 0) {
-        mergeResultsWorker(0, step);
+    const auto skip = options.Skip();
+    const auto limit = options.Limit();
+    const auto startKey = options.StartKeyObj();
+    const auto endKey = options.EndKeyObj();
+    const auto inclusiveEnd = options.InclusiveEnd();
+    const auto descending = options.Descending();
+    const auto groupLevel = options.GroupLevel();
+    const auto group = options.Group() || groupLevel > 0;
+    const auto keys = options.Keys();
+    
+    // each key is reduced on its own so the rows of a key have to be a single group
+    if (!!keys && (!group || groupLevel > 0)) {
+        throw MultiKeyReduceError{};
     }
     
-    return boost::make_shared<map_reduce_results_ptr::element_type>(results, offset, totalRows, skip, limit, descending);
-}
-
-map_reduce_result_array_ptr MapReduce::Execute(rs::jsapi::Runtime& rt, const MapReduceTask& task, const document_array& docs) {
-    map_reduce_result_array_ptr results = boost::make_shared<map_reduce_result_array_ptr::element_type>();
+    std::vector<std::string> encodedKeys;
+    std::vector<std::string> sortedKeys;
+    if (!!keys) {
+        EncodeKeys(keys, encodedKeys, sortedKeys);
+    }
+    
+    std::vector<map_reduce_shard_results_ptr> filteredResults;
+    filteredResults.reserve(shardResults.size());
+    decltype(filteredResults.size()) filteredRows = 0;
+    for (const auto& result : shardResults) {
+        auto filteredResult = boost::make_shared<map_reduce_shard_results_ptr::element_type>(
+            result, result->size(), startKey, endKey, inclusiveEnd, descending);
+        filteredRows += filteredResult->FilteredRows();
+        filteredResults.emplace_back(filteredResult);
+    }
     
-    // create the function script
-    std::string mapScript = "(function() { return ";
-    mapScript += task.Map();
-    mapScript += "; })();";
+    // split the shards into chunks of rows which are reduced on the thread pool
+    using chunk_type = std::pair<MapReduceShardResults::const_iterator, MapReduceShardResults::const_iterator>;
+    const auto chunkRows = std::max<decltype(filteredRows)>(10000, filteredRows / Config::GetCPUCount() + 1);
     
-    document_array::value_type empty;
-    auto doc = std::cref(empty);
-
-    // define a function in global scope implemented by a C++ lambda
-    rs::jsapi::Global::DefineFunction(rt, "emit", 
-        [&](const std::vector<rs::jsapi::Value>& args, rs::jsapi::Value&) {
-            auto source = ScriptArrayJsapiKeyValueSource::Create(args[0], args[1]);
+    std::vector<chunk_type> chunks;
+    if (!!keys) {
+        for (const auto& ranges : FindKeys(shardResults, sortedKeys)) {
+            for (const auto& range : ranges) {
+                if (range.first != range.second) {
+                    chunks.emplace_back(range);
+                }
+            }
+        }
+    } else {
+        for (const auto& result : filteredResults) {
+            for (auto iter = result->cbegin(), end = result->cend(); iter != end;) {
+                auto next = iter + std::min<decltype(filteredRows)>(chunkRows, std::distance(iter, end));
+                chunks.emplace_back(iter, next);
+                iter = next;
+            }
+        }
+    }
+    
+    struct ReduceGroup {
+        map_reduce_result_ptr first_;
+        MapReduceNativeReducer::State state_;
+        script_array_ptr value_;
+    };
+    
+    using reduce_groups = std::vector<ReduceGroup>;
+    
+    // the rows are sorted so the rows in a group are always next to each other,
+    // each group in a chunk is reduced with a single call to the reduce function
+    std::vector<reduce_groups> chunkGroups(chunks.size());
+    ExecuteTasks(chunks.size(), !!reducer, [&](std::size_t index) {
+        auto& groups = chunkGroups[index];
+        for (auto iter = chunks[index].first, end = chunks[index].second; iter != end;) {
+            auto groupEnd = std::next(iter);
+            while (groupEnd != end && CompareGroupKeys(*iter, *groupEnd, group, groupLevel) == 0) {
+                ++groupEnd;
+            }
+            
+            ReduceGroup reduceGroup{*iter, MapReduceNativeReducer::State{}, nullptr};
+            if (!!reducer) {
+                for (auto groupIter = iter; groupIter != groupEnd; ++groupIter) {
+                    reducer->Reduce(reduceGroup.state_, *groupIter);
+                }
+            } else {
+                auto rows = &(*iter);
+                reduceGroup.value_ = ExecuteReduce(reduce, std::distance(iter, groupEnd), 
+                    [rows](int index, rs::jsapi::Value& value) {
+                        CreateKeyArray(rows[index], value);
+                    },
+                    [rows](int index, rs::jsapi::Value& value) {
+                        GetFieldValue(rows[index], MapReduceResult::ValueIndex, value);
+                    });
+            }
             
-            auto resultArr = rs::scriptobject::ScriptArrayFactory::CreateArray(source);
-            auto result = MapReduceResult::Create(resultArr, doc);
-            results->push_back(result);
+            groups.emplace_back(std::move(reduceGroup));
+            iter = groupEnd;
+        }
     });
+    
+    reduce_groups partialGroups;
+    for (auto& groups : chunkGroups) {
+        std::move(groups.begin(), groups.end(), std::back_inserter(partialGroups));
+    }
+    
+    std::stable_sort(partialGroups.begin(), partialGroups.end(), [&](const ReduceGroup& a, const ReduceGroup& b) {
+        return CompareGroupKeys(a.first_, b.first_, group, groupLevel) < 0;
+    });
+    
+    // find the ranges of partial groups which share a key
+    using range_type = std::pair<reduce_groups::size_type, reduce_groups::size_type>;
+    std::vector<range_type> ranges;
+    for (reduce_groups::size_type i = 0, size = partialGroups.size(); i < size;) {
+        auto j = i + 1;
+        while (j < size && CompareGroupKeys(partialGroups[i].first_, partialGroups[j].first_, group, groupLevel) == 0) {
+            ++j;
+        }
+        
+        ranges.emplace_back(i, j);
+        i = j;
+    }
+    
+    // the groups of a multi-key query are returned in the order of the requested keys
+    if (!!keys) {
+        std::vector<range_type> keyRanges;
+        for (const auto& key : encodedKeys) {
+            auto iter = std::lower_bound(ranges.cbegin(), ranges.cend(), key, [&](const range_type& range, const std::string& key) {
+                return CompareKey(partialGroups[range.first].first_, key) < 0;
+            });
+            
+            if (iter != ranges.cend() && CompareKey(partialGroups[iter->first].first_, key) == 0) {
+                keyRanges.emplace_back(*iter);
+            }
+        }
+        
+        ranges = std::move(keyRanges);
+    }
+    
+    // only the groups which are returned need to be rereduced
+    std::vector<range_type> selectedRanges;
+    for (decltype(ranges.size()) i = skip, size = ranges.size(); i < size && selectedRanges.size() < limit; ++i) {
+        selectedRanges.emplace_back(ranges[descending && !keys ? size - i - 1 : i]);
+    }
+    
+    // a key which was requested more than once is only rereduced once
+    auto rereduceRanges = selectedRanges;
+    std::sort(rereduceRanges.begin(), rereduceRanges.end());
+    rereduceRanges.erase(std::unique(rereduceRanges.begin(), rereduceRanges.end()), rereduceRanges.end());
+    
+    if (!!reducer) {
+        for (const auto& range : rereduceRanges) {
+            for (auto i = range.first + 1; i < range.second; ++i) {
+                reducer->Rereduce(partialGroups[range.first].state_, partialGroups[i].state_);
+            }
+        }
+    } else {
+        // the runtimes belong to the pool threads so the rereduce is a single pool task
+        ExecuteTasks(1, false, [&](std::size_t) {
+            for (const auto& range : rereduceRanges) {
+                if (range.second - range.first > 1) {
+                    auto partials = &partialGroups[range.first];
+                    partials[0].value_ = ExecuteReduce(reduce, range.second - range.first, nullptr,
+                        [partials](int index, rs::jsapi::Value& value) {
+                            GetFieldValue(partials[index].value_, MapReduceResult::ValueIndex, value);
+                        });
+                }
+            }
+        });
+    }
+    
+    auto reducedResults = boost::make_shared<reduce_result_array_ptr::element_type>();
+    reducedResults->reserve(selectedRanges.size());
+    for (const auto& range : selectedRanges) {
+        const auto& reducedGroup = partialGroups[range.first];
+        
+        rs::scriptobject::utils::ArrayVector row{
+            GetGroupKey(reducedGroup.first_, group, groupLevel), 
+            !!reducer ? reducer->Finalize(reducedGroup.state_) : GetVectorValue(reducedGroup.value_, MapReduceResult::ValueIndex)
+        };
+        
+        rs::scriptobject::utils::ScriptArrayVectorSource source{row};
+        reducedResults->emplace_back(rs::scriptobject::ScriptArrayFactory::CreateArray(source));
+    }
+    
+    return boost::make_shared<map_reduce_results_ptr::element_type>(reducedResults);
+}
 
-    // TODO: elegantly handle JS syntax errors
-    // execute the script in the context of the runtime, getting the resulting function
-    rs::jsapi::Value func(rt);
-    rt.Evaluate(mapScript.c_str(), func);
+void MapReduce::ExecuteTasks(std::size_t count, bool callerExecutes, const std::function<void(std::size_t)>& task) {
+    // the tasks run under the caller's cancellation so they stop once the query is cancelled
+    const auto cancellation = MapReduceCancellation::Current();
+    
+    MapReduceTaskGroup tasks{*mapReduceThreadPool_, callerExecutes};
+    for (decltype(count) i = 0; i < count; ++i) {
+        tasks.Run([&, i]() {
+            MapReduceCancellation::Scope scope{cancellation};
+            MapReduceCancellation::CheckCurrent();
+            task(i);
+        });
+    }
+    
+    // the waiting thread cancels the query when the deadline passes, which interrupts any running scripts
+    if (!!cancellation && !tasks.WaitUntil(cancellation->Deadline())) {
+        cancellation->Cancel();
+    }
     
-    auto state = new MapReduceScriptObjectState{};
+    // script exceptions are passed back to the caller as compilation errors, unless
+    // the script was interrupted by the cancellation
+    try {
+        tasks.Wait();
+    } catch (const rs::jsapi::ScriptException& ex) {
+        MapReduceCancellation::CheckCurrent();
+        throw CompilationError{ex.what()};
+    }
+}
 
-    rs::scriptobject::ScriptObjectPtr scriptObj;
-    rs::jsapi::Value object(rt);
-    rs::jsapi::DynamicObject::Create(rt, 
-        [&](const char* name, rs::jsapi::Value& value) {
-            return MapReduce::GetFieldValue(scriptObj, name, value);
+script_array_ptr MapReduce::ExecuteReduce(const char* reduce, unsigned count, const reduce_value_function& getKey, const reduce_value_function& getValue) {
+    auto& rt = mapReduceThreadPool_->GetThreadRuntime();
+    auto& func = mapReduceThreadPool_->GetThreadFunctionCache().GetFunction(reduce);
+    
+    auto length = [count]() { return count; };
+    
+    // keys are null when rereducing
+    rs::jsapi::Value keys{rt};
+    if (!!getKey) {
+        rs::jsapi::DynamicArray::Create(rt, getKey, nullptr, length, nullptr, keys);
+    } else {
+        keys = JS::NullHandleValue;
+    }
+    
+    rs::jsapi::Value values{rt};
+    rs::jsapi::DynamicArray::Create(rt, getValue, nullptr, length, nullptr, values);
+    
+    rs::jsapi::FunctionArguments args{rt};
+    args.Append(keys);
+    args.Append(values);
+    args.Append(!getKey);
+    
+    rs::jsapi::Value result{rt};
+    func.CallFunction(args, result);
+    
+    MapReduceCancellation::CheckCurrent();
+    
+    // the reduced value is copied out of the runtime so it can be rereduced on any thread
+    rs::jsapi::Value key{rt};
+    key = JS::NullHandleValue;
+    
+    auto source = ScriptArrayJsapiKeyValueSource::Create(key, result);
+    return rs::scriptobject::ScriptArrayFactory::CreateArray(source);
+}
+
+void MapReduce::CreateKeyArray(map_reduce_result_ptr result, rs::jsapi::Value& value) {
+    rs::jsapi::DynamicArray::Create(value.getContext(), 
+        [result](int index, rs::jsapi::Value& value) {
+            if (index == 0) {
+                MapReduce::GetFieldValue(result, MapReduceResult::KeyIndex, value);
+            } else {
+                value = result->getId();
+            }
         }, 
         nullptr, 
-        [&](std::vector<std::string>& props, std::vector<std::pair<std::string, JSNative>>&) {
-            // TODO: only enumerate when really needed
-            for (decltype(scriptObj->getCount()) i = 0, count = scriptObj->getCount(); i < count; ++i) {
-                props.emplace_back(scriptObj->getName(i));
+        []() { return 2; }, 
+        nullptr,
+        value);
+}
+
+int MapReduce::CompareGroupKeys(const map_reduce_result_ptr& a, const map_reduce_result_ptr& b, bool group, std::uint64_t groupLevel) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+    
+    if (!group) {
+        return 0;
+    }
+    
+    // only the first group_level elements of array keys are compared, the encoded
+    // prefixes collate the same way as the elements so 1 and 1.0 are in one group
+    if (groupLevel > 0 && a->getKeyType() == ScriptObjectType::Array && b->getKeyType() == ScriptObjectType::Array) {
+        auto keyA = a->getCollationKey();
+        auto keyB = b->getCollationKey();
+        return MapReduceResult::CompareCollationKeys(keyA, MapReduceResultComparers::GetArrayPrefixSize(keyA, groupLevel), 
+            keyB, MapReduceResultComparers::GetArrayPrefixSize(keyB, groupLevel));
+    }
+    
+    return a->CompareKey(*b);
+}
+
+rs::scriptobject::utils::VectorValue MapReduce::GetGroupKey(const map_reduce_result_ptr& result, bool group, std::uint64_t groupLevel) {
+    if (!group) {
+        return rs::scriptobject::utils::VectorValue{};
+    }
+    
+    if (groupLevel > 0 && result->getKeyType() == rs::scriptobject::ScriptObjectType::Array) {
+        auto keyArr = result->getKeyArray();
+        if (keyArr->getCount() > groupLevel) {
+            rs::scriptobject::utils::ArrayVector key;
+            for (decltype(groupLevel) i = 0; i < groupLevel; ++i) {
+                key.emplace_back(GetVectorValue(keyArr, i));
             }
-            return true;
-        }, 
-        [state]() { delete state; },
-        object);
+            
+            rs::scriptobject::utils::ScriptArrayVectorSource source{key};
+            return rs::scriptobject::utils::VectorValue{rs::scriptobject::ScriptArrayFactory::CreateArray(source)};
+        }
+    }
+    
+    return GetVectorValue(result, MapReduceResult::KeyIndex);
+}
 
-    rs::jsapi::DynamicObject::SetPrivate(object, 0, state);
+rs::scriptobject::utils::VectorValue MapReduce::GetVectorValue(const script_array_ptr& arr, int index) {
+    return GetVectorValueImpl(arr, index);
+}
 
-    rs::jsapi::FunctionArguments args(rt);
-    args.Append(object);
+rs::scriptobject::utils::VectorValue MapReduce::GetVectorValue(const map_reduce_result_ptr& result, int index) {
+    return GetVectorValueImpl(result, index);
+}
 
-    for (DocumentCollection::size_type i = 0, size = docs.size(); i < size; ++i) {
-        doc = std::cref(docs[i]);
-        scriptObj = doc.get()->getObject();
+template <typename T>
+rs::scriptobject::utils::VectorValue MapReduce::GetVectorValueImpl(const T& arr, int index) {
+    switch (arr->getType(index)) {
+        case rs::scriptobject::ScriptObjectType::Boolean:
+            return rs::scriptobject::utils::VectorValue{arr->getBoolean(index)};
+        case rs::scriptobject::ScriptObjectType::Int32:
+            return rs::scriptobject::utils::VectorValue{static_cast<double>(arr->getInt32(index))};
+        case rs::scriptobject::ScriptObjectType::Double:
+            return rs::scriptobject::utils::VectorValue{arr->getDouble(index)};
+        case rs::scriptobject::ScriptObjectType::String:
+            return rs::scriptobject::utils::VectorValue{arr->getString(index)};
+        case rs::scriptobject::ScriptObjectType::Object:
+            return rs::scriptobject::utils::VectorValue{arr->getObject(index)};
+        case rs::scriptobject::ScriptObjectType::Array:
+            return rs::scriptobject::utils::VectorValue{arr->getArray(index)};
+        default:
+            return rs::scriptobject::utils::VectorValue{};
+    }
+}
+
+map_reduce_result_array_ptr MapReduce::Execute(rs::jsapi::Runtime& rt, const MapReduceTask& task, const document_array_ptr& docs) {
+    const auto size = docs->size();
+    if (size <= mapRangeSize_) {
+        return Execute(rt, task, docs, 0, size);
+    }
+    
+    // large shards are split into ranges which any idle map thread can pick up, the
+    // calling thread maps ranges too while it waits so a skewed shard can't hold up the map,
+    // which relies on the shard map itself running as a pool task with its own runtime
+    const auto ranges = (size + mapRangeSize_ - 1) / mapRangeSize_;
+    std::vector<map_reduce_result_array_ptr> rangeResults(ranges);
+    
+    ExecuteTasks(ranges, true, [&](std::size_t i) {
+        auto begin = i * mapRangeSize_;
+        rangeResults[i] = Execute(mapReduceThreadPool_->GetThreadRuntime(), task, docs, begin, std::min<std::size_t>(size, begin + mapRangeSize_));
+    });
+    
+    return MergeRanges(rangeResults);
+}
 
-        state->scriptObj_ = scriptObj;
+map_reduce_result_array_ptr MapReduce::MergeRanges(const std::vector<map_reduce_result_array_ptr>& rangeResults) {
+    decltype(rangeResults.size()) rows = 0;
+    for (const auto& result : rangeResults) {
+        rows += result->size();
+    }
+    
+    auto results = boost::make_shared<map_reduce_result_array_ptr::element_type>(rows);
+    
+    std::vector<decltype(rows)> rangeOffsets{0};
+    for (const auto& result : rangeResults) {
+        results->insert(results->end(), result->cbegin(), result->cend(), result);
+        rangeOffsets.emplace_back(results->size());
+    }
+    
+    // each range is already sorted so neighbouring ranges are merged in pairs
+    const auto ranges = rangeResults.size();
+    for (decltype(rows) step = 1; step < ranges; step *= 2) {
+        MapReduceCancellation::CheckCurrent();
+        
+        for (decltype(rows) i = 0; i + step < ranges; i += step * 2) {
+            auto begin = results->begin();
+            std::inplace_merge(begin + rangeOffsets[i], begin + rangeOffsets[i + step], begin + rangeOffsets[std::min(i + step * 2, ranges)],
+                [](const map_reduce_result_ptr& a, const map_reduce_result_ptr& b) {
+                    return MapReduceResult::Less(a, b);
+                });
+        }
+    }
+    
+    return results;
+}
 
-        func.CallFunction(args, false);
+map_reduce_result_array_ptr MapReduce::Execute(rs::jsapi::Runtime& rt, const MapReduceTask& task, const document_array_ptr& docs, std::size_t begin, std::size_t end) {
+    // the rows are allocated from an arena which pins the documents for all of them
+    auto arena = boost::make_shared<MapReduceResultArena>(docs);
+    
+    // native maps are evaluated against the documents without calling into the runtime
+    if (task.NativeMap()) {
+        auto results = task.NativeMap()->Execute(arena, begin, end);
+        SortResultArray(results);
+        return results;
+    }
+    
+    map_reduce_result_array_ptr results = boost::make_shared<map_reduce_result_array_ptr::element_type>();
+    results->add_arena(arena);
+    
+    // the compiled function, emit and the document wrapper are all owned by the runtime's cache
+    auto& cache = mapReduceThreadPool_->GetThreadFunctionCache();
+    
+    const Document* doc = nullptr;
+
+    cache.SetEmit([&](const std::vector<rs::jsapi::Value>& args) {
+        auto source = ScriptArrayJsapiKeyValueSource::Create(args[0], args[1]);
+        results->push_back(arena->Create(source, doc));
+    });
+    
+    auto& state = cache.GetDocumentState();
+    
+    BOOST_SCOPE_EXIT(&cache, &state) {
+        cache.SetEmit(nullptr);
+        state.scriptObj_.reset();
+    } BOOST_SCOPE_EXIT_END
+
+    // TODO: elegantly handle JS syntax errors
+    auto& func = cache.GetFunction(task.Map());
+    auto& args = cache.GetDocumentArguments();
+
+    const auto& arenaDocs = arena->Docs();
+    
+    // an interrupted call returns early, so the cancellation is checked after each one
+    if (mapBatchSize_ > 1) {
+        for (auto offset = begin; offset < end; offset += mapBatchSize_) {
+            auto count = std::min<decltype(arenaDocs.size())>(mapBatchSize_, end - offset);
+            cache.CallBatch(func, count, [&](std::size_t i) {
+                doc = arenaDocs[offset + i].get();
+                state.scriptObj_ = doc->getObject();
+            });
+            
+            MapReduceCancellation::CheckCurrent();
+        }
+    } else {
+        for (auto i = begin; i < end; ++i) {
+            doc = arenaDocs[i].get();
+            state.scriptObj_ = doc->getObject();
+
+            func.CallFunction(args, false);
+            
+            MapReduceCancellation::CheckCurrent();
+        }
     }
     
     SortResultArray(results);
@@ -247,9 +767,29 @@ map_reduce_result_array_ptr MapReduce::Execute(rs::jsapi::Runtime& rt, const Map
     return results;
 }
 
-void MapReduce::GetFieldValue(script_object_ptr scriptObj, const char* name, rs::jsapi::Value& value) {
+void MapReduce::GetFieldValue(MapReduceScriptObjectState& state, const char* name, rs::jsapi::Value& value) {
     int index = 0;
-    switch (scriptObj->getType(name, index)) {
+    if (state.scriptObj_->getType(name, index) != rs::scriptobject::ScriptObjectType::Unknown) {
+        GetFieldValue(state.scriptObj_, index, value);
+    } else {
+        value = JS::UndefinedHandleValue;
+    }
+}
+
+bool MapReduce::GetPropertyNames(MapReduceScriptObjectState& state, std::vector<std::string>& props) {
+    const auto& scriptObj = state.scriptObj_;
+    const auto count = scriptObj->getCount();
+    
+    props.reserve(props.size() + count);
+    for (decltype(scriptObj->getCount()) i = 0; i < count; ++i) {
+        props.emplace_back(scriptObj->getName(i));
+    }
+    
+    return true;
+}
+
+void MapReduce::GetFieldValue(script_object_ptr scriptObj, int index, rs::jsapi::Value& value) {
+    switch (scriptObj->getType(index)) {
         case rs::scriptobject::ScriptObjectType::Boolean:
             value = scriptObj->getBoolean(index);
             return;
@@ -282,6 +822,15 @@ void MapReduce::GetFieldValue(script_object_ptr scriptObj, const char* name, rs:
 }
 
 void MapReduce::GetFieldValue(script_array_ptr scriptArr, int index, rs::jsapi::Value& value) {
+    GetFieldValueImpl(scriptArr, index, value);
+}
+
+void MapReduce::GetFieldValue(map_reduce_result_ptr result, int index, rs::jsapi::Value& value) {
+    GetFieldValueImpl(result, index, value);
+}
+
+template <typename T>
+void MapReduce::GetFieldValueImpl(const T& scriptArr, int index, rs::jsapi::Value& value) {
     switch (scriptArr->getType(index)) {
         case rs::scriptobject::ScriptObjectType::Boolean:
             value = scriptArr->getBoolean(index);
@@ -319,15 +868,11 @@ void MapReduce::CreateValueObject(script_object_ptr obj, rs::jsapi::Value& value
     auto cx = value.getContext();
     rs::jsapi::DynamicObject::Create(cx, 
         [state](const char* name, rs::jsapi::Value& value) {
-            return MapReduce::GetFieldValue(state->scriptObj_, name, value);
+            return MapReduce::GetFieldValue(*state, name, value);
         }, 
         nullptr, 
         [state](std::vector<std::string>& props, std::vector<std::pair<std::string, JSNative>>&) {
-            // TODO: it would be useful to cache this for performance
-            for (decltype(state->scriptObj_->getCount()) i = 0, count = state->scriptObj_->getCount(); i < count; ++i) {
-                props.emplace_back(state->scriptObj_->getName(i));
-            }
-            return true;
+            return MapReduce::GetPropertyNames(*state, props);
         }, 
         [state]() { delete state; },
         value);
@@ -369,11 +914,15 @@ script_array_ptr MapReduce::GetValueScriptArray(const rs::jsapi::Value& arr) {
         uint64_t value = 0;
         void* ptr = nullptr;
         rs::jsapi::DynamicArray::GetPrivate(arr, value, ptr);
-        return reinterpret_cast<MapReduceScriptArrayState*>(ptr)->scriptArray_;
-    } else {
-        auto source = ScriptArrayJsapiSource::Create(arr);
-        return rs::scriptobject::ScriptArrayFactory::CreateArray(source);
+        
+        // the key and value arrays passed to reduce functions don't wrap a script array
+        if (ptr != nullptr) {
+            return reinterpret_cast<MapReduceScriptArrayState*>(ptr)->scriptArray_;
+        }
     }
+    
+    auto source = ScriptArrayJsapiSource::Create(arr);
+    return rs::scriptobject::ScriptArrayFactory::CreateArray(source);
 }
 
 void MapReduce::SortResultArray(map_reduce_result_array_ptr results) {
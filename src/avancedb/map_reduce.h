@@ -20,22 +20,31 @@
 #define MAP_REDUCE_H
 
 #include <string>
+#include <vector>
+#include <functional>
+
+#include <boost/make_shared.hpp>
 
 #include "types.h"
 #include "map_reduce_results.h"
+#include "map_reduce_native_map.h"
 #include "map_reduce_thread_pool.h"
 
 #include "libjsapi.h"
 
+#include "script_object_vector_source.h"
+
 class GetViewOptions;
+struct MapReduceScriptObjectState;
 
 class MapReduce final {
 public:
     
     class MapReduceTask final {
     public:
-        static inline MapReduceTask Create(script_object_ptr optionsObj) {
+        static inline MapReduceTask Create(script_object_ptr optionsObj, const char* defaultLanguage = nullptr) {
             auto lang = optionsObj->getString("language", false);
+            lang = lang ? lang : defaultLanguage;
             auto map = optionsObj->getString("map", false);
             auto reduce = optionsObj->getString("reduce", false);
             
@@ -47,37 +56,89 @@ public:
         const char* Reduce() const { return reduce_.c_str(); }
         const char* Language() const { return language_.c_str(); }
         
+        // a native map is parsed once with the task and shared by its copies
+        const map_reduce_native_map_ptr& NativeMap() const { return nativeMap_; }
+        
     private:
         MapReduceTask(const char* language, const char* map, const char* reduce) :
                 language_(language ? language : "javascript"), 
                 map_(map ? map : ""), 
-                reduce_(reduce ? reduce : "") {}
+                reduce_(reduce ? reduce : ""),
+                nativeMap_(MapReduceNativeMap::IsNativeLanguage(language_.c_str()) ? 
+                    boost::make_shared<MapReduceNativeMap>(MapReduceNativeMap::Create(map_.c_str())) : nullptr) {}
         
         const std::string map_;
         const std::string reduce_;
         const std::string language_;
+        const map_reduce_native_map_ptr nativeMap_;
     };
     
     MapReduce();
+    explicit MapReduce(unsigned mapBatchSize);
+    MapReduce(unsigned mapBatchSize, unsigned mapRangeSize);
     
     map_reduce_results_ptr Execute(const GetViewOptions& options, const MapReduceTask& task, document_collections_ptr_array colls);
+    map_reduce_results_ptr Execute(const GetViewOptions& options, map_reduce_view_ptr view, document_collections_ptr_array colls, sequence_type updateSequence);
+    
+    map_reduce_result_array_ptr Execute(const MapReduceTask& task, document_collections_ptr_array colls);
+    map_reduce_results_ptr Execute(const GetViewOptions& options, const MapReduceTask& task, const std::vector<map_reduce_result_array_ptr>& shardResults);
+    
+    // the sorted map rows of each collection
+    std::vector<map_reduce_result_array_ptr> Map(const MapReduceTask& task, document_collections_ptr_array colls);
     
     static script_object_ptr GetValueScriptObject(const rs::jsapi::Value& value);
     static script_array_ptr GetValueScriptArray(const rs::jsapi::Value& value);
     
 private:
     
-    map_reduce_result_array_ptr Execute(rs::jsapi::Runtime& rt, const MapReduceTask& task, const document_array& docs);
+    friend class MapReduceFunctionCache;
+    
+    using shard_map_function = std::function<map_reduce_result_array_ptr(rs::jsapi::Runtime&, const document_collection_ptr&, unsigned)>;
+    using reduce_value_function = std::function<void(int, rs::jsapi::Value&)>;
+    using key_range_type = std::pair<MapReduceResultArray::const_iterator, MapReduceResultArray::const_iterator>;
+    
+    static void ValidateLanguage(const MapReduceTask& task);
+    static bool IsReduce(const GetViewOptions& options, const MapReduceTask& task);
+    
+    std::vector<map_reduce_result_array_ptr> Map(const document_collections_ptr_array& colls, const shard_map_function& map);
+    map_reduce_results_ptr Merge(const GetViewOptions& options, const std::vector<map_reduce_result_array_ptr>& shardResults);
+    map_reduce_results_ptr MergeKeys(const GetViewOptions& options, const std::vector<map_reduce_result_array_ptr>& shardResults);
+    map_reduce_result_array_ptr Merge(const std::vector<map_reduce_shard_results_ptr>& filteredResults);
+    map_reduce_results_ptr Reduce(const GetViewOptions& options, const MapReduceTask& task, const std::vector<map_reduce_result_array_ptr>& shardResults);
+    
+    std::vector<std::vector<key_range_type>> FindKeys(const std::vector<map_reduce_result_array_ptr>& shardResults, const std::vector<std::string>& sortedKeys);
+    static void EncodeKeys(const script_array_ptr& keys, std::vector<std::string>& encodedKeys, std::vector<std::string>& sortedKeys);
+    static int CompareKey(const map_reduce_result_ptr& result, const std::string& key);
+    
+    void ExecuteTasks(std::size_t count, bool callerExecutes, const std::function<void(std::size_t)>& task);
+    script_array_ptr ExecuteReduce(const char* reduce, unsigned count, const reduce_value_function& getKey, const reduce_value_function& getValue);
+    
+    static int CompareGroupKeys(const map_reduce_result_ptr& a, const map_reduce_result_ptr& b, bool group, std::uint64_t groupLevel);
+    static rs::scriptobject::utils::VectorValue GetGroupKey(const map_reduce_result_ptr& result, bool group, std::uint64_t groupLevel);
+    static rs::scriptobject::utils::VectorValue GetVectorValue(const script_array_ptr& arr, int index);
+    static rs::scriptobject::utils::VectorValue GetVectorValue(const map_reduce_result_ptr& result, int index);
+    template <typename T> static rs::scriptobject::utils::VectorValue GetVectorValueImpl(const T& arr, int index);
+    
+    map_reduce_result_array_ptr Execute(rs::jsapi::Runtime& rt, const MapReduceTask& task, const document_array_ptr& docs);
+    map_reduce_result_array_ptr Execute(rs::jsapi::Runtime& rt, const MapReduceTask& task, const document_array_ptr& docs, std::size_t begin, std::size_t end);
+    static map_reduce_result_array_ptr MergeRanges(const std::vector<map_reduce_result_array_ptr>& rangeResults);
     
-    static void GetFieldValue(script_object_ptr scriptObj, const char* name, rs::jsapi::Value& value);
+    static void GetFieldValue(MapReduceScriptObjectState& state, const char* name, rs::jsapi::Value& value);
+    static bool GetPropertyNames(MapReduceScriptObjectState& state, std::vector<std::string>& props);
+    static void GetFieldValue(script_object_ptr scriptObj, int index, rs::jsapi::Value& value);
     static void GetFieldValue(script_array_ptr scriptObj, int index, rs::jsapi::Value& value);
+    static void GetFieldValue(map_reduce_result_ptr result, int index, rs::jsapi::Value& value);
+    template <typename T> static void GetFieldValueImpl(const T& scriptArr, int index, rs::jsapi::Value& value);
     
     static void CreateValueObject(script_object_ptr obj, rs::jsapi::Value& value);
     static void CreateValueArray(script_array_ptr arr, rs::jsapi::Value& value);
+    static void CreateKeyArray(map_reduce_result_ptr result, rs::jsapi::Value& value);
     
     static void SortResultArray(map_reduce_result_array_ptr results);
     
     MapReduceThreadPool::map_reduce_thread_pool_ptr mapReduceThreadPool_;
+    const unsigned mapBatchSize_;
+    const unsigned mapRangeSize_;
 };
 
 #endif	/* MAP_REDUCE_H */
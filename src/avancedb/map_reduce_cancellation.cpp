@@ -0,0 +1,81 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "map_reduce_cancellation.h"
+
+#include <boost/make_shared.hpp>
+
+#include "map_reduce_thread_pool.h"
+#include "rest_exceptions.h"
+
+static thread_local map_reduce_cancellation_ptr currentCancellation_;
+
+MapReduceCancellation::Scope::Scope(const map_reduce_cancellation_ptr& cancellation) :
+        previous_(currentCancellation_) {
+    currentCancellation_ = cancellation;
+}
+
+MapReduceCancellation::Scope::~Scope() {
+    currentCancellation_ = previous_;
+}
+
+MapReduceCancellation::MapReduceCancellation(std::chrono::milliseconds timeout) :
+        deadline_(clock::now() + timeout), cancelled_(false) {
+    
+}
+
+map_reduce_cancellation_ptr MapReduceCancellation::Create(unsigned timeout) {
+    return boost::make_shared<MapReduceCancellation>(std::chrono::milliseconds{timeout});
+}
+
+void MapReduceCancellation::Cancel() {
+    if (!cancelled_.exchange(true)) {
+        auto threadPool = MapReduceThreadPool::Get();
+        if (!!threadPool) {
+            threadPool->Interrupt();
+        }
+    }
+}
+
+bool MapReduceCancellation::IsCancelled() const {
+    return cancelled_ || clock::now() >= deadline_;
+}
+
+const MapReduceCancellation::clock::time_point& MapReduceCancellation::Deadline() const {
+    return deadline_;
+}
+
+void MapReduceCancellation::Check() const {
+    if (IsCancelled()) {
+        throw QueryTimeoutError{};
+    }
+}
+
+const map_reduce_cancellation_ptr& MapReduceCancellation::Current() {
+    return currentCancellation_;
+}
+
+bool MapReduceCancellation::IsCurrentCancelled() {
+    return !!currentCancellation_ && currentCancellation_->IsCancelled();
+}
+
+void MapReduceCancellation::CheckCurrent() {
+    if (!!currentCancellation_) {
+        currentCancellation_->Check();
+    }
+}
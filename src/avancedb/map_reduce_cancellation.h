@@ -0,0 +1,68 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_REDUCE_CANCELLATION_H
+#define MAP_REDUCE_CANCELLATION_H
+
+#include <atomic>
+#include <chrono>
+
+#include <boost/noncopyable.hpp>
+
+#include "types.h"
+
+// The deadline of a view query, map/reduce tasks stop at the next document, merge
+// step or script interrupt once it has passed or the query has been cancelled
+class MapReduceCancellation final : private boost::noncopyable {
+public:
+    using clock = std::chrono::steady_clock;
+    
+    // makes a cancellation current on the calling thread for the lifetime of the scope
+    class Scope final : private boost::noncopyable {
+    public:
+        explicit Scope(const map_reduce_cancellation_ptr& cancellation);
+        ~Scope();
+        
+    private:
+        const map_reduce_cancellation_ptr previous_;
+    };
+    
+    explicit MapReduceCancellation(std::chrono::milliseconds timeout);
+    
+    static map_reduce_cancellation_ptr Create(unsigned timeout);
+    
+    // interrupts any scripts running on the map/reduce threads
+    void Cancel();
+    
+    bool IsCancelled() const;
+    const clock::time_point& Deadline() const;
+    
+    // throws QueryTimeoutError once the query has been cancelled
+    void Check() const;
+    
+    static const map_reduce_cancellation_ptr& Current();
+    static bool IsCurrentCancelled();
+    static void CheckCurrent();
+    
+private:
+    const clock::time_point deadline_;
+    std::atomic<bool> cancelled_;
+};
+
+#endif	/* MAP_REDUCE_CANCELLATION_H */
+
@@ -0,0 +1,149 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "map_reduce_function_cache.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include <boost/scope_exit.hpp>
+
+#include "city.h"
+
+#include "map_reduce.h"
+
+MapReduceFunctionCache::MapReduceFunctionCache(rs::jsapi::Runtime& rt, std::size_t capacity) :
+        rt_(rt), capacity_(std::max<std::size_t>(capacity, 1)), docState_(new MapReduceScriptObjectState{}),
+        docObj_(rt), docArgs_(rt), batchFunc_(rt), batchDocs_(rt), batchCount_(0), hits_(0), misses_(0) {
+
+    // emit is defined once per runtime and forwards to whichever map is executing
+    rs::jsapi::Global::DefineFunction(rt_, "emit",
+        [this](const std::vector<rs::jsapi::Value>& args, rs::jsapi::Value&) {
+            if (!!emit_) {
+                emit_(args);
+            }
+    });
+    
+    // the CouchDB helper used by most reduce functions
+    rt_.Evaluate("function sum(values) { var total = 0; for (var i = 0; i < values.length; ++i) { total += values[i]; } return total; }");
+
+    // the document wrapper is reused, only the object it refers to changes between calls
+    auto state = docState_;
+    rs::jsapi::DynamicObject::Create(rt_,
+        [state](const char* name, rs::jsapi::Value& value) {
+            return MapReduce::GetFieldValue(*state, name, value);
+        },
+        nullptr,
+        [state](std::vector<std::string>& props, std::vector<std::pair<std::string, JSNative>>&) {
+            return MapReduce::GetPropertyNames(*state, props);
+        },
+        [state]() { delete state; },
+        docObj_);
+
+    rs::jsapi::DynamicObject::SetPrivate(docObj_, 0, state);
+
+    docArgs_.Append(docObj_);
+    
+    // a document which throws is skipped, the same as when the map is called directly
+    rt_.Evaluate("(function(map, docs) { for (var i = 0, n = docs.length; i < n; ++i) { try { map(docs[i]); } catch (e) { } } })", batchFunc_);
+    
+    // every element of the batch is the reused document wrapper, selecting an element
+    // points the wrapper at the document
+    rs::jsapi::DynamicArray::Create(rt_,
+        [this](int index, rs::jsapi::Value& value) {
+            batchSelect_(index);
+            value = docObj_;
+        },
+        nullptr,
+        [this]() { return static_cast<std::uint32_t>(batchCount_); },
+        nullptr,
+        batchDocs_);
+}
+
+rs::jsapi::Value& MapReduceFunctionCache::GetFunction(const char* source) {
+    auto hash = CityHash64(source, std::strlen(source));
+
+    auto indexIter = index_.find(hash);
+    if (indexIter != index_.end()) {
+        auto entryIter = indexIter->second;
+        if (entryIter->source_ == source) {
+            ++hits_;
+            entries_.splice(entries_.begin(), entries_, entryIter);
+            return *entryIter->func_;
+        }
+
+        // a hash collision, the old function makes way for the new one
+        entries_.erase(entryIter);
+        index_.erase(indexIter);
+    }
+
+    ++misses_;
+
+    std::string script = "(function() { return ";
+    script += source;
+    script += "; })();";
+
+    std::unique_ptr<rs::jsapi::Value> func{new rs::jsapi::Value{rt_}};
+    rt_.Evaluate(script.c_str(), *func);
+
+    if (entries_.size() >= capacity_) {
+        index_.erase(entries_.back().hash_);
+        entries_.pop_back();
+    }
+
+    entries_.emplace_front(Entry{hash, source, std::move(func)});
+    index_[hash] = entries_.begin();
+
+    return *entries_.front().func_;
+}
+
+void MapReduceFunctionCache::SetEmit(const emit_function& emit) {
+    emit_ = emit;
+}
+
+MapReduceScriptObjectState& MapReduceFunctionCache::GetDocumentState() {
+    return *docState_;
+}
+
+rs::jsapi::FunctionArguments& MapReduceFunctionCache::GetDocumentArguments() {
+    return docArgs_;
+}
+
+void MapReduceFunctionCache::CallBatch(rs::jsapi::Value& func, std::size_t count, const select_function& select) {
+    batchCount_ = count;
+    batchSelect_ = select;
+    
+    BOOST_SCOPE_EXIT(this_) {
+        this_->batchCount_ = 0;
+        this_->batchSelect_ = nullptr;
+    } BOOST_SCOPE_EXIT_END
+    
+    rs::jsapi::FunctionArguments args{rt_};
+    args.Append(func);
+    args.Append(batchDocs_);
+    
+    batchFunc_.CallFunction(args, false);
+}
+
+std::uint64_t MapReduceFunctionCache::Hits() const {
+    return hits_;
+}
+
+std::uint64_t MapReduceFunctionCache::Misses() const {
+    return misses_;
+}
@@ -0,0 +1,91 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_REDUCE_FUNCTION_CACHE_H
+#define MAP_REDUCE_FUNCTION_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+
+#include "libjsapi.h"
+
+#include "map_reduce_script_object_state.h"
+
+class MapReduceFunctionCache final : private boost::noncopyable {
+public:
+    using emit_function = std::function<void(const std::vector<rs::jsapi::Value>&)>;
+    using select_function = std::function<void(std::size_t)>;
+
+    MapReduceFunctionCache(rs::jsapi::Runtime& rt, std::size_t capacity);
+
+    rs::jsapi::Value& GetFunction(const char* source);
+
+    void SetEmit(const emit_function& emit);
+
+    MapReduceScriptObjectState& GetDocumentState();
+    rs::jsapi::FunctionArguments& GetDocumentArguments();
+    
+    // calls the map function for a batch of documents from a loop inside the runtime,
+    // select is called with the index of each document before it is mapped
+    void CallBatch(rs::jsapi::Value& func, std::size_t count, const select_function& select);
+
+    std::uint64_t Hits() const;
+    std::uint64_t Misses() const;
+
+private:
+
+    struct Entry final {
+        std::uint64_t hash_;
+        std::string source_;
+        std::unique_ptr<rs::jsapi::Value> func_;
+    };
+
+    using entry_list = std::list<Entry>;
+
+    rs::jsapi::Runtime& rt_;
+    const std::size_t capacity_;
+
+    // the most recently used function is at the front of the list
+    entry_list entries_;
+    std::unordered_map<std::uint64_t, entry_list::iterator> index_;
+
+    emit_function emit_;
+
+    MapReduceScriptObjectState* docState_;
+    rs::jsapi::Value docObj_;
+    rs::jsapi::FunctionArguments docArgs_;
+
+    rs::jsapi::Value batchFunc_;
+    rs::jsapi::Value batchDocs_;
+    std::size_t batchCount_;
+    select_function batchSelect_;
+
+    boost::atomic<std::uint64_t> hits_;
+    boost::atomic<std::uint64_t> misses_;
+};
+
+#endif	/* MAP_REDUCE_FUNCTION_CACHE_H */
+
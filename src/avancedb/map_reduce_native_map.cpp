@@ -0,0 +1,326 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "map_reduce_native_map.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <cstring>
+
+#include "libscriptobject_gason.h"
+#include "script_object_factory.h"
+#include "script_array_factory.h"
+#include "script_array_vector_source.h"
+
+#include "document.h"
+#include "map_reduce_result.h"
+#include "map_reduce_result_array.h"
+#include "map_reduce_result_arena.h"
+#include "map_reduce_result_comparers.h"
+#include "rest_exceptions.h"
+
+static const char* nativeLanguage = "native";
+
+MapReduceNativeMap::MapReduceNativeMap(script_object_ptr spec) : spec_(spec) {
+
+}
+
+bool MapReduceNativeMap::IsNativeLanguage(const char* language) {
+    return boost::iequals(nativeLanguage, language);
+}
+
+MapReduceNativeMap MapReduceNativeMap::Create(const char* map) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    std::vector<char> buffer{map, map + std::strlen(map)};
+    buffer.push_back('\0');
+
+    script_object_ptr spec;
+    try {
+        rs::scriptobject::ScriptObjectJsonSource source(buffer.data());
+        spec = rs::scriptobject::ScriptObjectFactory::CreateObject(source, false);
+    } catch (const std::exception&) {
+        throw CompilationError{"The native map function must be a JSON object"};
+    }
+
+    MapReduceNativeMap nativeMap{spec};
+
+    int index = 0;
+    switch (spec->getType("filter", index)) {
+        case ScriptObjectType::Object: {
+            // {"field":value,...} is shorthand for a set of equality filters
+            auto filters = spec->getObject(index);
+            for (decltype(filters->getCount()) i = 0, count = filters->getCount(); i < count; ++i) {
+                nativeMap.filters_.push_back(Filter{ParsePath(filters->getName(i)), Operator::Equal, filters, static_cast<int>(i)});
+            }
+            break;
+        }
+
+        case ScriptObjectType::Array: {
+            auto filters = spec->getArray(index);
+            for (decltype(filters->getCount()) i = 0, count = filters->getCount(); i < count; ++i) {
+                if (filters->getType(i) != ScriptObjectType::Object) {
+                    throw CompilationError{"Native map filters must be objects"};
+                }
+
+                auto filter = filters->getObject(i);
+                if (filter->getType("field") != ScriptObjectType::String) {
+                    throw CompilationError{"Native map filters require a field"};
+                }
+
+                auto op = filter->getType("op") == ScriptObjectType::String ? ParseOperator(filter->getString("op")) : Operator::Equal;
+
+                int valueIndex = 0;
+                if (filter->getType("value", valueIndex) == ScriptObjectType::Unknown && op != Operator::Exists) {
+                    throw CompilationError{"Native map filters require a value"};
+                }
+
+                nativeMap.filters_.push_back(Filter{ParsePath(filter->getString("field")), op, filter, valueIndex});
+            }
+            break;
+        }
+
+        case ScriptObjectType::Unknown:
+        case ScriptObjectType::Null:
+            break;
+
+        default:
+            throw CompilationError{"Native map filters must be an object or an array"};
+    }
+
+    nativeMap.key_ = ParseEmit(spec, "key");
+    nativeMap.value_ = ParseEmit(spec, "value");
+
+    return nativeMap;
+}
+
+map_reduce_result_array_ptr MapReduceNativeMap::Execute(const map_reduce_result_arena_ptr& arena, std::size_t begin, std::size_t end) const {
+    const auto& docs = arena->Docs();
+    
+    auto results = boost::make_shared<map_reduce_result_array_ptr::element_type>(end - begin);
+    results->add_arena(arena);
+
+    for (auto i = begin; i < end; ++i) {
+        const auto& doc = docs[i];
+        auto obj = doc->getObject();
+        if (IsMatch(obj)) {
+            rs::scriptobject::utils::ArrayVector row{GetEmitValue(key_, obj), GetEmitValue(value_, obj)};
+            rs::scriptobject::utils::ScriptArrayVectorSource source{row};
+            results->push_back(arena->Create(source, doc.get()));
+        }
+    }
+
+    return results;
+}
+
+bool MapReduceNativeMap::IsMatch(const script_object_ptr& doc) const {
+    for (const auto& filter : filters_) {
+        if (!IsMatch(filter, doc)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MapReduceNativeMap::IsMatch(const Filter& filter, const script_object_ptr& doc) {
+    script_object_ptr obj;
+    int index = 0;
+
+    // a missing field only ever matches a not equal filter, the same as undefined in JavaScript
+    if (!FindField(filter.path_, doc, obj, index)) {
+        return filter.op_ == Operator::NotEqual;
+    }
+
+    if (filter.op_ == Operator::Exists) {
+        return true;
+    }
+
+    auto compare = CompareValues(obj, index, filter.valueObj_, filter.valueIndex_);
+    switch (filter.op_) {
+        case Operator::Equal: return compare == 0;
+        case Operator::NotEqual: return compare != 0;
+        case Operator::Less: return compare < 0;
+        case Operator::LessOrEqual: return compare <= 0;
+        case Operator::Greater: return compare > 0;
+        case Operator::GreaterOrEqual: return compare >= 0;
+        default: return false;
+    }
+}
+
+rs::scriptobject::utils::VectorValue MapReduceNativeMap::GetEmitValue(const Emit& emit, const script_object_ptr& doc) {
+    if (!emit.array_) {
+        return emit.paths_.empty() ? rs::scriptobject::utils::VectorValue{} : GetFieldValue(emit.paths_[0], doc);
+    }
+
+    rs::scriptobject::utils::ArrayVector values;
+    for (const auto& path : emit.paths_) {
+        values.emplace_back(GetFieldValue(path, doc));
+    }
+
+    rs::scriptobject::utils::ScriptArrayVectorSource source{values};
+    return rs::scriptobject::utils::VectorValue{rs::scriptobject::ScriptArrayFactory::CreateArray(source)};
+}
+
+rs::scriptobject::utils::VectorValue MapReduceNativeMap::GetFieldValue(const field_path& path, const script_object_ptr& doc) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    script_object_ptr obj;
+    int index = 0;
+    if (!FindField(path, doc, obj, index)) {
+        return rs::scriptobject::utils::VectorValue{};
+    }
+
+    // numbers are always emitted as doubles, the same as they are from JavaScript
+    switch (obj->getType(index)) {
+        case ScriptObjectType::Boolean: return rs::scriptobject::utils::VectorValue{obj->getBoolean(index)};
+        case ScriptObjectType::Int32: return rs::scriptobject::utils::VectorValue{static_cast<double>(obj->getInt32(index))};
+        case ScriptObjectType::Double: return rs::scriptobject::utils::VectorValue{obj->getDouble(index)};
+        case ScriptObjectType::String: return rs::scriptobject::utils::VectorValue{obj->getString(index)};
+        case ScriptObjectType::Object: return rs::scriptobject::utils::VectorValue{obj->getObject(index)};
+        case ScriptObjectType::Array: return rs::scriptobject::utils::VectorValue{obj->getArray(index)};
+        default: return rs::scriptobject::utils::VectorValue{};
+    }
+}
+
+bool MapReduceNativeMap::FindField(const field_path& path, const script_object_ptr& doc, script_object_ptr& obj, int& index) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    obj = doc;
+    for (decltype(path.size()) i = 0, size = path.size(); i < size; ++i) {
+        auto type = obj->getType(path[i].c_str(), index);
+        if (type == ScriptObjectType::Unknown) {
+            return false;
+        }
+
+        if (i + 1 < size) {
+            if (type != ScriptObjectType::Object) {
+                return false;
+            }
+
+            obj = obj->getObject(index);
+        }
+    }
+
+    return true;
+}
+
+int MapReduceNativeMap::CompareValues(const script_object_ptr& a, int indexA, const script_object_ptr& b, int indexB) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    auto typeA = a->getType(indexA);
+    auto typeB = b->getType(indexB);
+
+    auto precedenceA = MapReduceResultComparers::GetScriptObjectTypePrecedence(typeA);
+    auto precedenceB = MapReduceResultComparers::GetScriptObjectTypePrecedence(typeB);
+    if (precedenceA != precedenceB) {
+        return precedenceA - precedenceB;
+    }
+
+    switch (typeA) {
+        case ScriptObjectType::Boolean: {
+            auto valueA = a->getBoolean(indexA);
+            auto valueB = b->getBoolean(indexB);
+            return valueA == valueB ? 0 : (valueA ? 1 : -1);
+        }
+
+        case ScriptObjectType::Int32:
+        case ScriptObjectType::Double: {
+            double valueA = typeA == ScriptObjectType::Int32 ? a->getInt32(indexA) : a->getDouble(indexA);
+            double valueB = typeB == ScriptObjectType::Int32 ? b->getInt32(indexB) : b->getDouble(indexB);
+            return valueA < valueB ? -1 : (valueA > valueB ? 1 : 0);
+        }
+
+        case ScriptObjectType::String:
+            return std::strcmp(a->getString(indexA), b->getString(indexB));
+
+        case ScriptObjectType::Array:
+            return MapReduceResultComparers::Compare(a->getArray(indexA), b->getArray(indexB));
+
+        case ScriptObjectType::Object:
+            return MapReduceResultComparers::Compare(a->getObject(indexA), b->getObject(indexB));
+
+        default:
+            return 0;
+    }
+}
+
+MapReduceNativeMap::Operator MapReduceNativeMap::ParseOperator(const char* op) {
+    if (std::strcmp(op, "eq") == 0) {
+        return Operator::Equal;
+    } else if (std::strcmp(op, "ne") == 0) {
+        return Operator::NotEqual;
+    } else if (std::strcmp(op, "lt") == 0) {
+        return Operator::Less;
+    } else if (std::strcmp(op, "lte") == 0) {
+        return Operator::LessOrEqual;
+    } else if (std::strcmp(op, "gt") == 0) {
+        return Operator::Greater;
+    } else if (std::strcmp(op, "gte") == 0) {
+        return Operator::GreaterOrEqual;
+    } else if (std::strcmp(op, "exists") == 0) {
+        return Operator::Exists;
+    }
+
+    std::string msg = "Unknown native map filter operator: ";
+    msg += op;
+    throw CompilationError{msg.c_str()};
+}
+
+MapReduceNativeMap::field_path MapReduceNativeMap::ParsePath(const char* path) {
+    field_path fields;
+    boost::split(fields, path, boost::is_any_of("."));
+    return fields;
+}
+
+MapReduceNativeMap::Emit MapReduceNativeMap::ParseEmit(const script_object_ptr& spec, const char* name) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    Emit emit{{}, false};
+
+    int index = 0;
+    switch (spec->getType(name, index)) {
+        case ScriptObjectType::String:
+            emit.paths_.emplace_back(ParsePath(spec->getString(index)));
+            break;
+
+        case ScriptObjectType::Array: {
+            emit.array_ = true;
+
+            auto paths = spec->getArray(index);
+            for (decltype(paths->getCount()) i = 0, count = paths->getCount(); i < count; ++i) {
+                if (paths->getType(i) != ScriptObjectType::String) {
+                    throw CompilationError{"Native map keys and values must be field paths"};
+                }
+
+                emit.paths_.emplace_back(ParsePath(paths->getString(i)));
+            }
+            break;
+        }
+
+        case ScriptObjectType::Unknown:
+        case ScriptObjectType::Null:
+            break;
+
+        default:
+            throw CompilationError{"Native map keys and values must be field paths"};
+    }
+
+    return emit;
+}
@@ -0,0 +1,79 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_REDUCE_NATIVE_MAP_H
+#define MAP_REDUCE_NATIVE_MAP_H
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+#include "script_object_vector_source.h"
+
+// A declarative map function evaluated directly against the documents, for example:
+// {"filter":{"type":"order"},"key":["customer","date"],"value":"total"}
+class MapReduceNativeMap final {
+public:
+
+    static bool IsNativeLanguage(const char* language);
+    static MapReduceNativeMap Create(const char* map);
+
+    map_reduce_result_array_ptr Execute(const map_reduce_result_arena_ptr& arena, std::size_t begin, std::size_t end) const;
+
+private:
+
+    using field_path = std::vector<std::string>;
+
+    enum class Operator { Equal, NotEqual, Less, LessOrEqual, Greater, GreaterOrEqual, Exists };
+
+    struct Filter final {
+        field_path path_;
+        Operator op_;
+        script_object_ptr valueObj_;
+        int valueIndex_;
+    };
+
+    struct Emit final {
+        std::vector<field_path> paths_;
+        bool array_;
+    };
+
+    MapReduceNativeMap(script_object_ptr spec);
+
+    bool IsMatch(const script_object_ptr& doc) const;
+    static bool IsMatch(const Filter& filter, const script_object_ptr& doc);
+
+    static rs::scriptobject::utils::VectorValue GetEmitValue(const Emit& emit, const script_object_ptr& doc);
+    static rs::scriptobject::utils::VectorValue GetFieldValue(const field_path& path, const script_object_ptr& doc);
+    static bool FindField(const field_path& path, const script_object_ptr& doc, script_object_ptr& obj, int& index);
+
+    static int CompareValues(const script_object_ptr& a, int indexA, const script_object_ptr& b, int indexB);
+
+    static Operator ParseOperator(const char* op);
+    static field_path ParsePath(const char* path);
+    static Emit ParseEmit(const script_object_ptr& spec, const char* name);
+
+    const script_object_ptr spec_;
+    std::vector<Filter> filters_;
+    Emit key_;
+    Emit value_;
+};
+
+#endif	/* MAP_REDUCE_NATIVE_MAP_H */
+
@@ -0,0 +1,289 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "map_reduce_native_reducer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "city.h"
+
+#include "script_object_factory.h"
+#include "script_array_factory.h"
+#include "script_array_vector_source.h"
+
+#include "map_reduce_result.h"
+#include "map_reduce_result_comparers.h"
+#include "rest_exceptions.h"
+
+static const char* sumValueError = "The _sum function requires that map values be numbers or arrays of numbers";
+static const char* statsValueError = "The _stats function requires that map values be numbers";
+
+MapReduceNativeReducer::State::State() :
+        count_(0), sum_(0), min_(std::numeric_limits<double>::infinity()),
+        max_(-std::numeric_limits<double>::infinity()), sumsqr_(0) {
+
+}
+
+MapReduceNativeReducer::MapReduceNativeReducer(Type type) : type_(type) {
+
+}
+
+bool MapReduceNativeReducer::IsNative(const char* reduce) {
+    return reduce != nullptr && reduce[0] == '_';
+}
+
+MapReduceNativeReducer MapReduceNativeReducer::Create(const char* reduce) {
+    if (std::strcmp(reduce, "_sum") == 0) {
+        return MapReduceNativeReducer{Type::Sum};
+    } else if (std::strcmp(reduce, "_count") == 0) {
+        return MapReduceNativeReducer{Type::Count};
+    } else if (std::strcmp(reduce, "_stats") == 0) {
+        return MapReduceNativeReducer{Type::Stats};
+    } else if (std::strcmp(reduce, "_approx_count_distinct") == 0) {
+        return MapReduceNativeReducer{Type::ApproxCountDistinct};
+    }
+
+    std::string msg = "Unknown builtin reduce function: ";
+    msg += reduce;
+    throw BuiltInReduceError{msg.c_str()};
+}
+
+MapReduceNativeReducer::Type MapReduceNativeReducer::GetType() const {
+    return type_;
+}
+
+void MapReduceNativeReducer::Reduce(State& state, const map_reduce_result_ptr& result) const {
+    ++state.count_;
+
+    switch (type_) {
+        case Type::Sum: ReduceSum(state, result); break;
+        case Type::Stats: ReduceStats(state, result); break;
+        case Type::ApproxCountDistinct: ReduceApproxCountDistinct(state, result); break;
+        default: break;
+    }
+}
+
+void MapReduceNativeReducer::Rereduce(State& state, const State& other) const {
+    state.count_ += other.count_;
+    state.sum_ += other.sum_;
+    state.sumsqr_ += other.sumsqr_;
+    state.min_ = std::min(state.min_, other.min_);
+    state.max_ = std::max(state.max_, other.max_);
+
+    if (state.sums_.size() < other.sums_.size()) {
+        state.sums_.resize(other.sums_.size(), 0);
+    }
+
+    for (decltype(other.sums_.size()) i = 0, size = other.sums_.size(); i < size; ++i) {
+        state.sums_[i] += other.sums_[i];
+    }
+
+    if (state.registers_.empty()) {
+        state.registers_ = other.registers_;
+    } else {
+        for (decltype(other.registers_.size()) i = 0, size = other.registers_.size(); i < size; ++i) {
+            state.registers_[i] = std::max(state.registers_[i], other.registers_[i]);
+        }
+    }
+}
+
+rs::scriptobject::utils::VectorValue MapReduceNativeReducer::Finalize(const State& state) const {
+    switch (type_) {
+        case Type::Sum: {
+            if (state.sums_.empty()) {
+                return rs::scriptobject::utils::VectorValue{state.sum_};
+            }
+
+            // scalar values are summed into the first element, as CouchDB does
+            rs::scriptobject::utils::ArrayVector sums;
+            for (decltype(state.sums_.size()) i = 0, size = state.sums_.size(); i < size; ++i) {
+                sums.emplace_back(i == 0 ? state.sums_[i] + state.sum_ : state.sums_[i]);
+            }
+
+            rs::scriptobject::utils::ScriptArrayVectorSource source{sums};
+            return rs::scriptobject::utils::VectorValue{rs::scriptobject::ScriptArrayFactory::CreateArray(source)};
+        }
+
+        case Type::Stats: {
+            rs::scriptobject::utils::ObjectVector stats = {
+                std::make_pair("sum", rs::scriptobject::utils::VectorValue{state.sum_}),
+                std::make_pair("count", rs::scriptobject::utils::VectorValue{static_cast<double>(state.count_)}),
+                std::make_pair("min", rs::scriptobject::utils::VectorValue{state.min_}),
+                std::make_pair("max", rs::scriptobject::utils::VectorValue{state.max_}),
+                std::make_pair("sumsqr", rs::scriptobject::utils::VectorValue{state.sumsqr_})
+            };
+
+            rs::scriptobject::utils::ScriptObjectVectorSource source{stats};
+            return rs::scriptobject::utils::VectorValue{rs::scriptobject::ScriptObjectFactory::CreateObject(source)};
+        }
+
+        case Type::ApproxCountDistinct:
+            return rs::scriptobject::utils::VectorValue{EstimateCardinality(state.registers_)};
+
+        default:
+            return rs::scriptobject::utils::VectorValue{static_cast<double>(state.count_)};
+    }
+}
+
+void MapReduceNativeReducer::ReduceSum(State& state, const map_reduce_result_ptr& result) const {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    switch (result->getValueType()) {
+        case ScriptObjectType::Double:
+            state.sum_ += result->getValueDouble();
+            break;
+
+        case ScriptObjectType::Int32:
+            state.sum_ += result->getValueInt32();
+            break;
+
+        case ScriptObjectType::Array: {
+            auto arr = result->getValueArray();
+            auto count = arr->getCount();
+            if (state.sums_.size() < count) {
+                state.sums_.resize(count, 0);
+            }
+
+            for (decltype(count) i = 0; i < count; ++i) {
+                switch (arr->getType(i)) {
+                    case ScriptObjectType::Double: state.sums_[i] += arr->getDouble(i); break;
+                    case ScriptObjectType::Int32: state.sums_[i] += arr->getInt32(i); break;
+                    default: throw BuiltInReduceError{sumValueError};
+                }
+            }
+            break;
+        }
+
+        default:
+            throw BuiltInReduceError{sumValueError};
+    }
+}
+
+void MapReduceNativeReducer::ReduceStats(State& state, const map_reduce_result_ptr& result) const {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    double value = 0;
+    switch (result->getValueType()) {
+        case ScriptObjectType::Double: value = result->getValueDouble(); break;
+        case ScriptObjectType::Int32: value = result->getValueInt32(); break;
+        default: throw BuiltInReduceError{statsValueError};
+    }
+
+    state.sum_ += value;
+    state.sumsqr_ += value * value;
+    state.min_ = std::min(state.min_, value);
+    state.max_ = std::max(state.max_, value);
+}
+
+void MapReduceNativeReducer::ReduceApproxCountDistinct(State& state, const map_reduce_result_ptr& result) const {
+    if (state.registers_.empty()) {
+        state.registers_.resize(1 << HyperLogLogPrecision, 0);
+    }
+
+    auto hash = HashValue(result, MapReduceResult::KeyIndex, 0);
+
+    // the top bits pick the register, the rank is the position of the first set bit in the rest
+    auto index = hash >> (64 - HyperLogLogPrecision);
+    auto bits = (hash << HyperLogLogPrecision) | (1ull << (HyperLogLogPrecision - 1));
+
+    std::uint8_t rank = 1;
+    while ((bits & (1ull << 63)) == 0) {
+        ++rank;
+        bits <<= 1;
+    }
+
+    state.registers_[index] = std::max(state.registers_[index], rank);
+}
+
+double MapReduceNativeReducer::EstimateCardinality(const std::vector<std::uint8_t>& registers) {
+    if (registers.empty()) {
+        return 0;
+    }
+
+    const double m = registers.size();
+
+    double sum = 0;
+    unsigned zeros = 0;
+    for (auto reg : registers) {
+        sum += std::ldexp(1.0, -static_cast<int>(reg));
+        zeros += reg == 0 ? 1 : 0;
+    }
+
+    auto estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+
+    // linear counting is more accurate for small cardinalities
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * std::log(m / zeros);
+    }
+
+    return std::round(estimate);
+}
+
+template <typename T>
+std::uint64_t MapReduceNativeReducer::HashValue(const T& container, int index, std::uint64_t seed) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    auto type = container->getType(index);
+
+    // numbers hash the same regardless of how they are stored, the same as they collate
+    auto precedence = MapReduceResultComparers::GetScriptObjectTypePrecedence(type);
+    seed = CityHash64WithSeed(reinterpret_cast<const char*>(&precedence), sizeof(precedence), seed);
+
+    switch (type) {
+        case ScriptObjectType::Boolean: {
+            char value = container->getBoolean(index) ? 1 : 0;
+            return CityHash64WithSeed(&value, sizeof(value), seed);
+        }
+
+        case ScriptObjectType::Int32:
+        case ScriptObjectType::Double: {
+            double value = type == ScriptObjectType::Int32 ? container->getInt32(index) : container->getDouble(index);
+            return CityHash64WithSeed(reinterpret_cast<const char*>(&value), sizeof(value), seed);
+        }
+
+        case ScriptObjectType::String: {
+            auto value = container->getString(index);
+            return CityHash64WithSeed(value, std::strlen(value), seed);
+        }
+
+        case ScriptObjectType::Array: {
+            auto arr = container->getArray(index);
+            for (decltype(arr->getCount()) i = 0, count = arr->getCount(); i < count; ++i) {
+                seed = HashValue(arr, i, seed);
+            }
+            return seed;
+        }
+
+        case ScriptObjectType::Object: {
+            auto obj = container->getObject(index);
+            for (decltype(obj->getCount()) i = 0, count = obj->getCount(); i < count; ++i) {
+                auto name = obj->getName(i);
+                seed = CityHash64WithSeed(name, std::strlen(name), seed);
+                seed = HashValue(obj, i, seed);
+            }
+            return seed;
+        }
+
+        default:
+            return seed;
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_REDUCE_NATIVE_REDUCER_H
+#define MAP_REDUCE_NATIVE_REDUCER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+#include "script_object_vector_source.h"
+
+class MapReduceNativeReducer final {
+public:
+
+    enum class Type { Sum, Count, Stats, ApproxCountDistinct };
+
+    class State final {
+    public:
+        State();
+
+    private:
+        friend class MapReduceNativeReducer;
+
+        std::uint64_t count_;
+        double sum_;
+        std::vector<double> sums_;
+        double min_;
+        double max_;
+        double sumsqr_;
+        std::vector<std::uint8_t> registers_;
+    };
+
+    static bool IsNative(const char* reduce);
+    static MapReduceNativeReducer Create(const char* reduce);
+
+    Type GetType() const;
+
+    void Reduce(State& state, const map_reduce_result_ptr& result) const;
+    void Rereduce(State& state, const State& other) const;
+
+    rs::scriptobject::utils::VectorValue Finalize(const State& state) const;
+
+private:
+
+    static constexpr unsigned HyperLogLogPrecision{10};
+
+    MapReduceNativeReducer(Type type);
+
+    void ReduceSum(State& state, const map_reduce_result_ptr& result) const;
+    void ReduceStats(State& state, const map_reduce_result_ptr& result) const;
+    void ReduceApproxCountDistinct(State& state, const map_reduce_result_ptr& result) const;
+
+    static double EstimateCardinality(const std::vector<std::uint8_t>& registers);
+
+    template <typename T>
+    static std::uint64_t HashValue(const T& container, int index, std::uint64_t seed);
+
+    Type type_;
+};
+
+#endif	/* MAP_REDUCE_NATIVE_REDUCER_H */
+
@@ -21,82 +21,182 @@
 #include <cstring>
 
 #include "document.h"
+#include "map_reduce_result_arena.h"
 #include "map_reduce_result_comparers.h"
 
-MapReduceResult::MapReduceResult(script_array_ptr&& result, document_ptr&& doc) :
-        result_(result), doc_(doc), id_(doc->getId()) {
-}
-
-map_reduce_result_ptr MapReduceResult::Create(script_array_ptr result, document_ptr doc) {    
-    return new MapReduceResult{std::move(result), std::move(doc)};
+template <typename T>
+void MapReduceResult::InitCollationKey(const T& container, MapReduceResultArena& arena) {
+    // the key is encoded in the arena's buffer and only its bytes are kept
+    auto& key = arena.key_;
+    key.clear();
+    
+    MapReduceResultComparers::AppendCollationKey(key, container, KeyIndex);
+    collationKeySize_ = key.size();
+    key += id_;
+    collationKeyLength_ = key.size();
+    
+    auto bytes = arena.AllocateBytes(key.size());
+    std::memcpy(bytes, key.data(), key.size());
+    collationKey_ = bytes;
+}
+
+MapReduceResult::MapReduceResult(const rs::scriptobject::ScriptArraySource& source, const Document* doc, MapReduceResultArena& arena) :
+        id_(doc->getId()), doc_(doc), inline_(true), scalars_() {
+    for (unsigned i = 0; i < scalars_.size(); ++i) {
+        auto& scalar = scalars_[i];
+        scalar.type_ = source.type(i);
+        
+        switch (scalar.type_) {
+            case rs::scriptobject::ScriptObjectType::Boolean: scalar.boolean_ = source.getBoolean(i); break;
+            case rs::scriptobject::ScriptObjectType::Int32: scalar.int32_ = source.getInt32(i); break;
+            case rs::scriptobject::ScriptObjectType::Double: scalar.double_ = source.getDouble(i); break;
+            case rs::scriptobject::ScriptObjectType::String:
+                if (i == KeyIndex) {
+                    // the key is only read from the source until it has been encoded
+                    scalar.string_ = source.getString(i);
+                } else {
+                    auto length = source.getStringLength(i);
+                    auto bytes = arena.AllocateBytes(length + 1);
+                    std::memcpy(bytes, source.getString(i), length);
+                    bytes[length] = '\0';
+                    scalar.string_ = bytes;
+                }
+                break;
+            default: break;
+        }
+    }
+    
+    InitCollationKey(this, arena);
+    
+    // a string key is encoded as a tag followed by the null terminated string
+    if (scalars_[KeyIndex].type_ == rs::scriptobject::ScriptObjectType::String) {
+        scalars_[KeyIndex].string_ = collationKey_ + 1;
+    }
+}
+
+MapReduceResult::MapReduceResult(script_array_ptr&& result, const Document* doc, MapReduceResultArena& arena) :
+        id_(doc->getId()), doc_(doc), inline_(false) {
+    // the array is moved into the row last so nothing needs releasing if the key throws
+    InitCollationKey(result, arena);
+    new (&result_) script_array_ptr{std::move(result)};
+}
+
+MapReduceResult::~MapReduceResult() {
+    if (!inline_) {
+        result_.~script_array_ptr();
+    }
+}
+
+bool MapReduceResult::IsScalar(rs::scriptobject::ScriptObjectType type) {
+    return type != rs::scriptobject::ScriptObjectType::Object && type != rs::scriptobject::ScriptObjectType::Array;
 }
 
 const char* MapReduceResult::MapReduceResult::getId() const {
     return id_;
 }
 
+const Document* MapReduceResult::getDoc() const {
+    return doc_;
+}
+
+unsigned MapReduceResult::getCount() const {
+    return ValueIndex + 1;
+}
+
+rs::scriptobject::ScriptObjectType MapReduceResult::getType(int index) const {
+    return inline_ ? scalars_[index].type_ : result_->getType(index);
+}
+
+const char* MapReduceResult::getString(int index) const {
+    return inline_ ? scalars_[index].string_ : result_->getString(index);
+}
+
+std::int32_t MapReduceResult::getInt32(int index) const {
+    return inline_ ? scalars_[index].int32_ : result_->getInt32(index);
+}
+
+double MapReduceResult::getDouble(int index) const {
+    return inline_ ? scalars_[index].double_ : result_->getDouble(index);
+}
+
+bool MapReduceResult::getBoolean(int index) const {
+    return inline_ ? scalars_[index].boolean_ : result_->getBoolean(index);
+}
+
+const script_object_ptr MapReduceResult::getObject(int index) const {
+    return inline_ ? script_object_ptr{} : result_->getObject(index);
+}
+
+const script_array_ptr MapReduceResult::getArray(int index) const {
+    return inline_ ? script_array_ptr{} : result_->getArray(index);
+}
+
 rs::scriptobject::ScriptObjectType MapReduceResult::getKeyType() const {
-    return result_->getType(KeyIndex);
+    return getType(KeyIndex);
 }
 
 rs::scriptobject::ScriptObjectType MapReduceResult::getValueType() const {
-    return result_->getType(ValueIndex);
+    return getType(ValueIndex);
 }
 
-const document_ptr MapReduceResult::getDoc() const {
-    return doc_;
+const char* MapReduceResult::getCollationKey() const {
+    return collationKey_;
+}
+
+std::size_t MapReduceResult::getCollationKeySize() const {
+    return collationKeySize_;
 }
 
-const script_array_ptr MapReduceResult::getResultArray() const {
-    return result_;
+std::size_t MapReduceResult::getCollationKeyLength() const {
+    return collationKeyLength_;
 }
 
 const char* MapReduceResult::getKeyString() const {
-    return result_->getString(KeyIndex);
+    return getString(KeyIndex);
 }
 
 std::int32_t MapReduceResult::getKeyInt32() const {
-    return result_->getInt32(KeyIndex);
+    return getInt32(KeyIndex);
 }
 
 double MapReduceResult::getKeyDouble() const {
-    return result_->getDouble(KeyIndex);
+    return getDouble(KeyIndex);
 }
 
 bool MapReduceResult::getKeyBoolean() const {
-    return result_->getBoolean(KeyIndex);
+    return getBoolean(KeyIndex);
 }
 
 const script_object_ptr MapReduceResult::getKeyObject() const {
-    return result_->getObject(KeyIndex);
+    return getObject(KeyIndex);
 }
 
 const script_array_ptr MapReduceResult::getKeyArray() const {
-    return result_->getArray(KeyIndex);
+    return getArray(KeyIndex);
 }
 
 const char* MapReduceResult::getValueString() const {
-    return result_->getString(ValueIndex);
+    return getString(ValueIndex);
 }
 
 std::int32_t MapReduceResult::getValueInt32() const {
-    return result_->getInt32(ValueIndex);
+    return getInt32(ValueIndex);
 }
 
 double MapReduceResult::getValueDouble() const {
-    return result_->getDouble(ValueIndex);
+    return getDouble(ValueIndex);
 }
 
 bool MapReduceResult::getValueBoolean() const {
-    return result_->getBoolean(ValueIndex);
+    return getBoolean(ValueIndex);
 }
 
 const script_object_ptr MapReduceResult::getValueObject() const {
-    return result_->getObject(ValueIndex);
+    return getObject(ValueIndex);
 }
 
 const script_array_ptr MapReduceResult::getValueArray() const {
-    return result_->getArray(ValueIndex);
+    return getArray(ValueIndex);
 }
 
 bool MapReduceResult::Less(const map_reduce_result_ptr& a, const map_reduce_result_ptr& b) {
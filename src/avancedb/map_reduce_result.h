@@ -22,6 +22,10 @@
 #include <boost/noncopyable.hpp>
 
 #include <cstring>
+#include <cstdint>
+#include <string>
+#include <array>
+#include <algorithm>
 
 #include "types.h"
 
@@ -31,11 +35,18 @@ public:
     static constexpr unsigned KeyIndex{0};
     static constexpr unsigned ValueIndex{1};
     
-    static map_reduce_result_ptr Create(script_array_ptr result, document_ptr doc);
-    
     const char* getId() const;
-    const document_ptr getDoc() const;
-    const script_array_ptr getResultArray() const;
+    const Document* getDoc() const;
+    
+    // the key and value are read by index the same way as a script array
+    unsigned getCount() const;
+    rs::scriptobject::ScriptObjectType getType(int index) const;
+    const char* getString(int index) const;
+    std::int32_t getInt32(int index) const;
+    double getDouble(int index) const;
+    bool getBoolean(int index) const;
+    const script_object_ptr getObject(int index) const;
+    const script_array_ptr getArray(int index) const;
     
     rs::scriptobject::ScriptObjectType getKeyType() const;
     rs::scriptobject::ScriptObjectType getValueType() const;        
@@ -58,17 +69,65 @@ public:
         return std::strcmp(id_, other.id_);
     }
     
+    // the collation key is the key encoded so it sorts with memcmp, followed by the id,
+    // the size is the size of the encoded key and the length includes the id
+    const char* getCollationKey() const;
+    std::size_t getCollationKeySize() const;
+    std::size_t getCollationKeyLength() const;
+    
+    inline int Compare(const MapReduceResult& other) const {
+        return CompareCollationKeys(collationKey_, collationKeyLength_, other.collationKey_, other.collationKeyLength_);
+    }
+    
+    inline int CompareKey(const MapReduceResult& other) const {
+        return CompareCollationKeys(collationKey_, collationKeySize_, other.collationKey_, other.collationKeySize_);
+    }
+    
+    static inline int CompareCollationKeys(const char* a, std::size_t sizeA, const char* b, std::size_t sizeB) {
+        auto compare = std::memcmp(a, b, std::min(sizeA, sizeB));
+        return compare != 0 ? compare : (sizeA < sizeB ? -1 : (sizeA > sizeB ? 1 : 0));
+    }
+    
     static bool Less(const map_reduce_result_ptr& a, const map_reduce_result_ptr& b);
     static bool Less(const script_object_ptr& a, const script_object_ptr& b);
     static bool Less(const script_array_ptr& a, const script_array_ptr& b);
     
+    static bool IsScalar(rs::scriptobject::ScriptObjectType type);
+    
 private:
     
-    MapReduceResult(script_array_ptr&&, document_ptr&&);
+    friend class MapReduceResultArena;
+    
+    struct Scalar final {
+        rs::scriptobject::ScriptObjectType type_;
+        union {
+            bool boolean_;
+            std::int32_t int32_;
+            double double_;
+            const char* string_;
+        };
+    };
+    
+    // rows with scalar keys and values are held inline, anything else in a script array,
+    // the collation key and the strings of an inline row are allocated from the arena
+    MapReduceResult(const rs::scriptobject::ScriptArraySource& source, const Document*, MapReduceResultArena&);
+    MapReduceResult(script_array_ptr&&, const Document*, MapReduceResultArena&);
+    ~MapReduceResult();
+    
+    template <typename T> void InitCollationKey(const T& container, MapReduceResultArena&);
     
     const char* id_;
-    document_ptr doc_;
-    script_array_ptr result_;
+    const Document* doc_;
+    const char* collationKey_;
+    std::uint32_t collationKeySize_;
+    std::uint32_t collationKeyLength_;
+    const bool inline_;
+    
+    // an inline row only has the scalars and any other row only has the script array
+    union {
+        std::array<Scalar, 2> scalars_;
+        script_array_ptr result_;
+    };
 
 };
 
@@ -0,0 +1,102 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "map_reduce_result_arena.h"
+
+#include "script_array_factory.h"
+
+#include "document.h"
+
+MapReduceResultArena::MapReduceResultArena(document_array_ptr docs) : 
+        docs_(docs), size_(0), capacity_(0), byteBlockSize_(0), byteBlockUsed_(0) {
+    
+}
+
+MapReduceResultArena::~MapReduceResultArena() {
+    for (auto& block : blocks_) {
+        for (size_type i = 0; i < block.size_; ++i) {
+            auto result = reinterpret_cast<MapReduceResult*>(&block.rows_[i]);
+            result->~MapReduceResult();
+        }
+    }
+}
+
+const document_array& MapReduceResultArena::Docs() const {
+    return *docs_;
+}
+
+map_reduce_result_ptr MapReduceResultArena::Create(const rs::scriptobject::ScriptArraySource& source, const Document* doc) {
+    MapReduceResult* ptr = nullptr;
+    
+    // if the constructor throws the slot isn't counted and is reused by the next row
+    if (MapReduceResult::IsScalar(source.type(MapReduceResult::KeyIndex)) && MapReduceResult::IsScalar(source.type(MapReduceResult::ValueIndex))) {
+        ptr = new (Allocate()) MapReduceResult{source, doc, *this};
+    } else {
+        auto result = rs::scriptobject::ScriptArrayFactory::CreateArray(source);
+        ptr = new (Allocate()) MapReduceResult{std::move(result), doc, *this};
+    }
+    
+    ++blocks_.back().size_;
+    ++size_;
+    return ptr;
+}
+
+void* MapReduceResultArena::Allocate() {
+    if (blocks_.empty() || blocks_.back().size_ == blocks_.back().capacity_) {
+        size_type blockSize = blocks_.empty() ? MinBlockSize : blocks_.back().capacity_ * 2;
+        if (blockSize > MaxBlockSize) {
+            blockSize = MaxBlockSize;
+        }
+        
+        std::unique_ptr<storage_type[]> rows{new storage_type[blockSize]};
+        blocks_.push_back(Block{std::move(rows), blockSize, 0});
+        capacity_ += blockSize;
+    }
+    
+    auto& block = blocks_.back();
+    return &block.rows_[block.size_];
+}
+
+char* MapReduceResultArena::AllocateBytes(size_type size) {
+    if (byteBlocks_.empty() || byteBlockUsed_ + size > byteBlockSize_) {
+        size_type blockSize = byteBlocks_.empty() ? MinByteBlockSize : byteBlockSize_ * 2;
+        if (blockSize > MaxByteBlockSize) {
+            blockSize = MaxByteBlockSize;
+        }
+        if (blockSize < size) {
+            blockSize = size;
+        }
+        
+        std::unique_ptr<char[]> bytes{new char[blockSize]};
+        byteBlocks_.push_back(std::move(bytes));
+        byteBlockSize_ = blockSize;
+        byteBlockUsed_ = 0;
+    }
+    
+    auto bytes = byteBlocks_.back().get() + byteBlockUsed_;
+    byteBlockUsed_ += size;
+    return bytes;
+}
+
+MapReduceResultArena::size_type MapReduceResultArena::size() const {
+    return size_;
+}
+
+MapReduceResultArena::size_type MapReduceResultArena::capacity() const {
+    return capacity_;
+}
@@ -0,0 +1,87 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_REDUCE_RESULT_ARENA_H
+#define MAP_REDUCE_RESULT_ARENA_H
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include "types.h"
+#include "map_reduce_result.h"
+
+// Allocates the rows of a map in blocks which are released together, the documents
+// are pinned by the arena so the rows only need to hold a plain pointer to them,
+// the blocks start small and double so an arena for a few rows stays small
+class MapReduceResultArena final : private boost::noncopyable {
+public:
+    using size_type = std::size_t;
+    
+    MapReduceResultArena(document_array_ptr docs);
+    ~MapReduceResultArena();
+    
+    const document_array& Docs() const;
+    
+    // scalar keys and values are copied into the row, otherwise the source is copied into a script array
+    map_reduce_result_ptr Create(const rs::scriptobject::ScriptArraySource& source, const Document* doc);
+    
+    // the number of rows created and the number of rows the blocks have room for
+    size_type size() const;
+    size_type capacity() const;
+    
+private:
+    friend class MapReduceResult;
+    
+    static constexpr size_type MinBlockSize{4};
+    static constexpr size_type MaxBlockSize{1024};
+    static constexpr size_type MinByteBlockSize{256};
+    static constexpr size_type MaxByteBlockSize{64 * 1024};
+    
+    void* Allocate();
+    
+    // the collation keys of the rows are packed into byte blocks, a key never spans two blocks
+    char* AllocateBytes(size_type size);
+    
+    using storage_type = std::aligned_storage<sizeof(MapReduceResult), alignof(MapReduceResult)>::type;
+    
+    // a block only counts a row once its constructor has returned
+    struct Block final {
+        std::unique_ptr<storage_type[]> rows_;
+        size_type capacity_;
+        size_type size_;
+    };
+    
+    const document_array_ptr docs_;
+    std::vector<Block> blocks_;
+    size_type size_;
+    size_type capacity_;
+    
+    std::vector<std::unique_ptr<char[]>> byteBlocks_;
+    size_type byteBlockSize_;
+    size_type byteBlockUsed_;
+    
+    // rows encode their collation keys here before copying them into a byte block
+    std::string key_;
+};
+
+#endif	/* MAP_REDUCE_RESULT_ARENA_H */
+
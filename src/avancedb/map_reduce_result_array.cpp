@@ -18,26 +18,17 @@
 
 #include "map_reduce_result_array.h"
 
-#include <stdexcept>
+#include "map_reduce_result_arena.h"
 
 MapReduceResultArray::MapReduceResultArray(collection::size_type capacity) {
     data_.reserve(capacity);
 }
 
-MapReduceResultArray::MapReduceResultArray(MapReduceResultArray&& rhs) : data_(std::move(rhs.data_)) {
+MapReduceResultArray::MapReduceResultArray(MapReduceResultArray&& rhs) : 
+        data_(std::move(rhs.data_)), arenas_(std::move(rhs.arenas_)) {
     
 }
 
-MapReduceResultArray::~MapReduceResultArray() {    
-    // TODO: revise this
-    // if there are no sources then we own the pointers
-    if (sources_.size() == 0) {
-        for (auto iter : data_) {
-            delete iter;
-        }
-    }
-}
-
 MapReduceResultArray::size_type MapReduceResultArray::capacity() const {
     return data_.capacity();
 }
@@ -75,13 +66,25 @@ void MapReduceResultArray::push_back(map_reduce_result_ptr ptr) {
 }
 
 void MapReduceResultArray::insert(iterator position, const_iterator first, const_iterator last, const map_reduce_result_array_ptr& sourcePtr) {
-    // TODO: this case has two personalities - that should be refactored out sometime
-    if (data_.size() > 0 && sources_.size() == 0) {
-        throw std::logic_error{"Unable to insert - mixed pointer ownership is not supported"};
+    data_.insert(position, first, last);
+    add_source(sourcePtr);
+}
+
+void MapReduceResultArray::add_arena(const map_reduce_result_arena_ptr& arena) {
+    arenas_.insert(arena);
+}
+
+void MapReduceResultArray::add_source(const map_reduce_result_array_ptr& sourcePtr) {
+    arenas_.insert(sourcePtr->arenas_.cbegin(), sourcePtr->arenas_.cend());
+}
+
+MapReduceResultArray::size_type MapReduceResultArray::arena_capacity() const {
+    size_type capacity = 0;
+    for (const auto& arena : arenas_) {
+        capacity += arena->capacity();
     }
     
-    data_.insert(position, first, last);
-    sources_.push_back(sourcePtr);
+    return capacity;
 }
 
 MapReduceResultArray::const_reference MapReduceResultArray::operator[](int n) const {
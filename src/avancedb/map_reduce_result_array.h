@@ -20,6 +20,9 @@
 #define MAP_REDUCE_RESULT_ARRAY_H
 
 #include <vector>
+#include <unordered_set>
+
+#include <boost/functional/hash.hpp>
 
 #include "types.h"
 #include "map_reduce_result.h"
@@ -37,7 +40,6 @@ public:
     MapReduceResultArray(collection::size_type capacity = 1024);
     MapReduceResultArray(const MapReduceResultArray&) = delete;
     MapReduceResultArray(MapReduceResultArray&& rhs);
-    ~MapReduceResultArray();
     
     size_type capacity() const;
     void reserve(size_type n);
@@ -55,13 +57,20 @@ public:
     
     void push_back(map_reduce_result_ptr);
     
+    // the rows are owned by arenas, an array keeps alive the arenas of every row it holds
+    void add_arena(const map_reduce_result_arena_ptr& arena);
+    void add_source(const map_reduce_result_array_ptr& sourcePtr);
+    
+    // the number of row slots allocated in the arenas, including slots for rows this array doesn't hold
+    size_type arena_capacity() const;
+    
     collection& operator=(const collection&) = delete;
     const_reference operator[](int n) const;
     
 private:
     collection data_;
     
-    std::vector<map_reduce_result_array_ptr> sources_;
+    std::unordered_set<map_reduce_result_arena_ptr, boost::hash<map_reduce_result_arena_ptr>> arenas_;
 };
 
 #endif	/* MAP_REDUCE_RESULT_ARRAY_H */
@@ -18,34 +18,120 @@
 
 #include "map_reduce_result_comparers.h"
 
-MapReduceResultComparers::MapReduceResultKeyAdapter::MapReduceResultKeyAdapter(const map_reduce_result_ptr& result) :
-    result_(result) {    
-}
+#include <cstdint>
 
-rs::scriptobject::ScriptObjectType MapReduceResultComparers::MapReduceResultKeyAdapter::getType(int) const {
-    return result_->getKeyType();
-}
+// each value starts with a tag byte ordered by type precedence, arrays and objects end
+// with a zero byte which sorts before the tag of any further element
+static const char arrayEnd = 0x00;
+static const char objectMember = 0x01;
+static const char objectEnd = 0x00;
+static const char stringEnd = 0x00;
 
-const char* MapReduceResultComparers::MapReduceResultKeyAdapter::getString(int) const {
-    return result_->getKeyString();
+void MapReduceResultComparers::AppendCollationKey(std::string& key, const script_array_ptr& arr, int index) {
+    AppendCollationKeyImpl(key, arr, index);
 }
 
-std::int32_t MapReduceResultComparers::MapReduceResultKeyAdapter::getInt32(int) const {
-    return result_->getKeyInt32();
+void MapReduceResultComparers::AppendCollationKey(std::string& key, const script_object_ptr& obj, int index) {
+    AppendCollationKeyImpl(key, obj, index);
 }
 
-double MapReduceResultComparers::MapReduceResultKeyAdapter::getDouble(int) const {
-    return result_->getKeyDouble();
+void MapReduceResultComparers::AppendCollationKey(std::string& key, const MapReduceResult* result, int index) {
+    AppendCollationKeyImpl(key, result, index);
 }
 
-bool MapReduceResultComparers::MapReduceResultKeyAdapter::getBoolean(int) const {
-    return result_->getKeyBoolean();
+std::size_t MapReduceResultComparers::GetArrayPrefixSize(const char* key, std::uint64_t count) {
+    auto end = key + 1;
+    for (decltype(count) i = 0; i < count && *end != arrayEnd; ++i) {
+        end = SkipCollationKeyValue(end);
+    }
+    
+    return end - key;
 }
 
-const script_object_ptr MapReduceResultComparers::MapReduceResultKeyAdapter::getObject(int) const {
-    return result_->getKeyObject();
+const char* MapReduceResultComparers::SkipCollationKeyValue(const char* key) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+    
+    auto tag = *key++;
+    if (tag == GetScriptObjectTypePrecedence(ScriptObjectType::Boolean) + 1) {
+        return key + 1;
+    } else if (tag == GetScriptObjectTypePrecedence(ScriptObjectType::Double) + 1) {
+        return key + sizeof(double);
+    } else if (tag == GetScriptObjectTypePrecedence(ScriptObjectType::String) + 1) {
+        return key + std::strlen(key) + 1;
+    } else if (tag == GetScriptObjectTypePrecedence(ScriptObjectType::Array) + 1) {
+        while (*key != arrayEnd) {
+            key = SkipCollationKeyValue(key);
+        }
+        return key + 1;
+    } else if (tag == GetScriptObjectTypePrecedence(ScriptObjectType::Object) + 1) {
+        while (*key == objectMember) {
+            key += std::strlen(key + 1) + 2;
+            key = SkipCollationKeyValue(key);
+        }
+        return key + 1;
+    }
+    
+    return key;
 }
 
-const script_array_ptr MapReduceResultComparers::MapReduceResultKeyAdapter::getArray(int) const {
-    return result_->getKeyArray();
-}
\ No newline at end of file
+template <typename T>
+void MapReduceResultComparers::AppendCollationKeyImpl(std::string& key, const T& container, int index) {
+    using ScriptObjectType = rs::scriptobject::ScriptObjectType;
+
+    auto type = container->getType(index);
+    key.push_back(static_cast<char>(GetScriptObjectTypePrecedence(type) + 1));
+
+    switch (type) {
+        case ScriptObjectType::Boolean:
+            key.push_back(container->getBoolean(index) ? 1 : 0);
+            break;
+
+        case ScriptObjectType::Int32:
+        case ScriptObjectType::Double: {
+            double value = type == ScriptObjectType::Int32 ? container->getInt32(index) : container->getDouble(index);
+            if (value == 0) {
+                value = 0; // -0 and 0 collate the same
+            }
+
+            // flip the sign bit of positive numbers and every bit of negative numbers
+            // so the big-endian bytes sort in numeric order
+            std::uint64_t bits = 0;
+            std::memcpy(&bits, &value, sizeof(bits));
+            bits = (bits & (1ull << 63)) != 0 ? ~bits : bits | (1ull << 63);
+
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                key.push_back(static_cast<char>((bits >> shift) & 0xff));
+            }
+            break;
+        }
+
+        case ScriptObjectType::String:
+            key.append(container->getString(index));
+            key.push_back(stringEnd);
+            break;
+
+        case ScriptObjectType::Array: {
+            auto arr = container->getArray(index);
+            for (decltype(arr->getCount()) i = 0, count = arr->getCount(); i < count; ++i) {
+                AppendCollationKeyImpl(key, arr, i);
+            }
+            key.push_back(arrayEnd);
+            break;
+        }
+
+        case ScriptObjectType::Object: {
+            auto obj = container->getObject(index);
+            for (decltype(obj->getCount()) i = 0, count = obj->getCount(); i < count; ++i) {
+                key.push_back(objectMember);
+                key.append(obj->getName(i));
+                key.push_back(stringEnd);
+                AppendCollationKeyImpl(key, obj, i);
+            }
+            key.push_back(objectEnd);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
@@ -22,6 +22,7 @@
 #include "types.h"
 
 #include <cstring>
+#include <string>
 #include <algorithm>
 
 #include "map_reduce_result.h"
@@ -32,14 +33,7 @@ public:
     
     template <typename T, typename std::enable_if<std::is_same<T, map_reduce_result_ptr>::value>::type* = nullptr>
     static int Compare(const T& a, const T& b) {
-        MapReduceResultKeyAdapter tempA{a}, tempB{b};
-        
-        auto diff = CompareImpl(&tempA, &tempB);
-        if (diff == 0) {
-            diff = a->CompareId(*b);
-        }
-        
-        return diff;
+        return a->Compare(*b);
     }
     
     template <typename T, typename std::enable_if<std::is_same<T, map_reduce_result_ptr>::value>::type* = nullptr>
@@ -62,6 +56,16 @@ public:
         return CompareValueImpl(index, a, b);
     }
     
+    // encodes a value so the encodings of two values compare with memcmp the same way the
+    // values collate, numbers are compared by value regardless of how they are stored
+    static void AppendCollationKey(std::string& key, const script_array_ptr& arr, int index);
+    static void AppendCollationKey(std::string& key, const script_object_ptr& obj, int index);
+    static void AppendCollationKey(std::string& key, const MapReduceResult* result, int index);
+    
+    // the size of the encoding of an array key cut down to its first count elements,
+    // so group_level prefixes compare with memcmp too
+    static std::size_t GetArrayPrefixSize(const char* key, std::uint64_t count);
+    
     static inline int GetScriptObjectTypePrecedence(const rs::scriptobject::ScriptObjectType& type) {
         using ScriptObjectType = rs::scriptobject::ScriptObjectType;
 
@@ -78,25 +82,12 @@ public:
     }
     
 private:
-    class MapReduceResultKeyAdapter final {
-    public:
-        MapReduceResultKeyAdapter(const map_reduce_result_ptr&);
-        
-        rs::scriptobject::ScriptObjectType getType(int) const;
-        inline unsigned getCount() const { return 1; }
-
-        const char* getString(int) const;
-        std::int32_t getInt32(int) const;
-        double getDouble(int) const;
-        bool getBoolean(int) const;
-        const script_object_ptr getObject(int) const;
-        const script_array_ptr getArray(int) const;
-        
-    private:
-        const map_reduce_result_ptr& result_;
-    };
+    template <typename T>
+    static void AppendCollationKeyImpl(std::string& key, const T& container, int index);
+    
+    static const char* SkipCollationKeyValue(const char* key);
     
-    template <typename T, typename std::enable_if<std::is_same<T, script_array_ptr>::value || std::is_same<T, MapReduceResultKeyAdapter*>::value>::type* = nullptr>
+    template <typename T, typename std::enable_if<std::is_same<T, script_array_ptr>::value>::type* = nullptr>
     static int CompareImpl(const T& a, const T& b) {        
         using ScriptObjectType = rs::scriptobject::ScriptObjectType;
         
@@ -20,6 +20,9 @@
 #include "map_reduce_result_comparers.h"
 #include "map_reduce_query_key.h"
 #include "map_reduce_results_iterator.h"
+#include "map_reduce_shard_results.h"
+
+#include <boost/make_shared.hpp>
 
 #include <algorithm>
 #include <cstring>
@@ -30,6 +33,18 @@ MapReduceResults::MapReduceResults(map_reduce_result_array_ptr results, size_typ
     
 }
 
+MapReduceResults::MapReduceResults(std::vector<map_reduce_shard_results_ptr> shardResults, size_type offset, size_type totalRows, size_type skip, size_type limit, bool descending) :
+        shardResults_(std::move(shardResults)), skip_(skip), limit_(limit),
+        descending_(descending), offset_(offset), totalRows_(totalRows) {
+    
+}
+
+MapReduceResults::MapReduceResults(reduce_result_array_ptr reducedResults) :
+        results_(boost::make_shared<map_reduce_result_array_ptr::element_type>(0)), skip_(0), limit_(0),
+        descending_(false), offset_(0), totalRows_(0), reducedResults_(reducedResults) {
+    
+}
+
 MapReduceResults::size_type MapReduceResults::Offset() const {
     return std::min(offset_ + skip_, totalRows_);
 }
@@ -47,6 +62,30 @@ MapReduceResultsIterator MapReduceResults::Iterator() const {
     return MapReduceResultsIterator{*this, descending_};
 }
 
+const map_reduce_result_array_ptr& MapReduceResults::Results() const {
+    std::call_once(resultsFlag_, [&]() {
+        if (!results_) {
+            results_ = boost::make_shared<map_reduce_result_array_ptr::element_type>(skip_ + limit_);
+            
+            // the merge iterator returns the rows in the requested order, but the array is kept in key order
+            MapReduceResultsIterator iter{shardResults_, 0, skip_ + limit_, descending_};
+            for (auto result = iter.Next(); !!result; result = iter.Next()) {
+                results_->push_back(result);
+            }
+            
+            if (descending_) {
+                std::reverse(results_->begin(), results_->end());
+            }
+            
+            for (const auto& shardResult : shardResults_) {
+                results_->add_source(shardResult->SourceResults());
+            }
+        }
+    });
+    
+    return results_;
+}
+
 MapReduceResults::size_type MapReduceResults::Subtract(size_type a, size_type b) {
     auto v = a - b;
     if (v > a) {
@@ -56,20 +95,26 @@ MapReduceResults::size_type MapReduceResults::Subtract(size_type a, size_type b)
 }
 
 MapReduceResults::const_iterator MapReduceResults::cbegin() const {
+    const auto& results = Results();
     if (!descending_) {
-        return results_->cbegin() + skip_;
+        return results->cbegin() + skip_;
     } else {
-        auto startIndex = Subtract(results_->size(), skip_);
+        auto startIndex = Subtract(results->size(), skip_);
         startIndex = Subtract(startIndex, limit_);
-        return results_->cbegin() + startIndex;
+        return results->cbegin() + startIndex;
     }
 }
 
 MapReduceResults::const_iterator MapReduceResults::cend() const {
+    const auto& results = Results();
     if (!descending_) {    
-        auto endIndex = std::min(results_->size(), skip_ + limit_);
-        return results_->cbegin() + endIndex;
+        auto endIndex = std::min(results->size(), skip_ + limit_);
+        return results->cbegin() + endIndex;
     } else {
-        return results_->cend() - skip_;
+        return results->cend() - skip_;
     }
+}
+
+reduce_result_array_ptr MapReduceResults::ReducedResults() const {
+    return reducedResults_;
 }
\ No newline at end of file
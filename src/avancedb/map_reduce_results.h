@@ -19,6 +19,9 @@
 #ifndef MAP_REDUCE_RESULTS_H
 #define MAP_REDUCE_RESULTS_H
 
+#include <mutex>
+#include <vector>
+
 #include "types.h"
 #include "document_collection.h"
 #include "get_view_options.h"
@@ -36,25 +39,41 @@ public:
     
     MapReduceResults(map_reduce_result_array_ptr results, size_type offset, size_type totalRows, size_type skip, size_type limit, size_type descending);
     
+    // the sorted shard results are merged as they are iterated rather than up front,
+    // the skip and limit must already be clamped to the filtered rows of the shards
+    MapReduceResults(std::vector<map_reduce_shard_results_ptr> shardResults, size_type offset, size_type totalRows, size_type skip, size_type limit, bool descending);
+    MapReduceResults(reduce_result_array_ptr reducedResults);
+    
     size_type Offset() const;
     size_type FilteredRows() const;
     size_type TotalRows() const;
     
     MapReduceResultsIterator Iterator() const;
     
+    // merges any shard results into a single array the first time they are called
     const_iterator cbegin() const;
     const_iterator cend() const;    
     
+    // the [key, value] rows of a reduced view, or null if the view wasn't reduced
+    reduce_result_array_ptr ReducedResults() const;
+    
 private:
     
+    friend class MapReduceResultsIterator;
+    
     static size_type Subtract(size_type, size_type);    
     
-    const map_reduce_result_array_ptr results_;
+    const map_reduce_result_array_ptr& Results() const;
+    
+    const std::vector<map_reduce_shard_results_ptr> shardResults_;
+    mutable map_reduce_result_array_ptr results_;
+    mutable std::once_flag resultsFlag_;
     const bool descending_;
     const size_type limit_;
     const size_type skip_;
     const size_type offset_;
     const size_type totalRows_;
+    const reduce_result_array_ptr reducedResults_;
 };
 
 #endif	/* MAP_REDUCE_RESULTS_H */
@@ -18,24 +18,99 @@
 
 #include "map_reduce_results_iterator.h"
 
+#include <algorithm>
+
+#include "map_reduce_result.h"
+
 MapReduceResultsIterator::MapReduceResultsIterator(const MapReduceResults& results, bool descending) :
-        results_(results),
-        begin_(results.cbegin()),
-        end_(results.cend()),
-        empty_(begin_ == end_),
-        ibegin_(!descending || empty_ ? begin_ : end_ - 1),
-        iend_(!descending || empty_ ? end_ : begin_ - 1),
-        iter_(ibegin_),
-        direction_(!descending ? 1 : -1) {
+        merge_(IsMerged(results)),
+        empty_(true),
+        direction_(!descending ? 1 : -1),
+        skip_(results.skip_),
+        remaining_(results.limit_) {
+    if (merge_) {
+        for (const auto& shardResult : results.shardResults_) {
+            if (shardResult->cbegin() != shardResult->cend()) {
+                heap_.emplace_back(shardResult->cbegin(), shardResult->cend());
+            }
+        }
+        
+        MakeHeap();
+    } else {
+        begin_ = results.cbegin();
+        end_ = results.cend();
+        empty_ = begin_ == end_;
+        ibegin_ = !descending || empty_ ? begin_ : end_ - 1;
+        iend_ = !descending || empty_ ? end_ : begin_ - 1;
+        iter_ = ibegin_;
+    }
+}
+
+MapReduceResultsIterator::MapReduceResultsIterator(const std::vector<map_reduce_shard_results_ptr>& shardResults, size_type skip, size_type limit, bool descending) :
+        merge_(true),
+        empty_(true),
+        direction_(!descending ? 1 : -1),
+        skip_(skip),
+        remaining_(limit) {
+    for (const auto& shardResult : shardResults) {
+        if (shardResult->cbegin() != shardResult->cend()) {
+            heap_.emplace_back(shardResult->cbegin(), shardResult->cend());
+        }
+    }
     
+    MakeHeap();
 }
 
 MapReduceResultsIterator::const_reference MapReduceResultsIterator::Next() {
-    if (!empty_ && iter_ != iend_) {
+    if (merge_) {
+        return NextMerged();
+    } else if (!empty_ && iter_ != iend_) {
         const auto& value = *iter_;
         iter_ += direction_;
         return value;
     } else {
         return null_;
     }
-}
\ No newline at end of file
+}
+
+MapReduceResultsIterator::const_reference MapReduceResultsIterator::NextMerged() {
+    const auto descending = direction_ < 0;
+    auto compare = [this](const range_type& a, const range_type& b) { return Compare(a, b); };
+    
+    while (remaining_ > 0 && heap_.size() > 0) {
+        std::pop_heap(heap_.begin(), heap_.end(), compare);
+        
+        auto& range = heap_.back();
+        const auto& value = !descending ? *range.first++ : *--range.second;
+        
+        if (range.first == range.second) {
+            heap_.pop_back();
+        } else {
+            std::push_heap(heap_.begin(), heap_.end(), compare);
+        }
+        
+        if (skip_ > 0) {
+            --skip_;
+        } else {
+            --remaining_;
+            return value;
+        }
+    }
+    
+    return null_;
+}
+
+void MapReduceResultsIterator::MakeHeap() {
+    std::make_heap(heap_.begin(), heap_.end(), [this](const range_type& a, const range_type& b) { return Compare(a, b); });
+}
+
+bool MapReduceResultsIterator::Compare(const range_type& a, const range_type& b) const {
+    // the shard with the next row is at the top of the heap, descending results are read from the back
+    return direction_ < 0 ? 
+        MapReduceResult::Less(*std::prev(a.second), *std::prev(b.second)) :
+        MapReduceResult::Less(*b.first, *a.first);
+}
+
+bool MapReduceResultsIterator::IsMerged(const MapReduceResults& results) {
+    return !results.results_ && results.shardResults_.size() > 0;
+}
@@ -19,26 +19,47 @@
 #ifndef MAP_REDUCE_RESULTS_ITERATOR_H
 #define MAP_REDUCE_RESULTS_ITERATOR_H
 
+#include <utility>
+#include <vector>
+
 #include "map_reduce_results.h"
+#include "map_reduce_shard_results.h"
 
 class MapReduceResultsIterator final {
 public:
     using const_reference = MapReduceResults::const_reference;
+    using size_type = MapReduceResults::size_type;
     
     MapReduceResultsIterator(const MapReduceResults& results, bool descending);
     
+    // merges the sorted shard results a row at a time, only holding the position in each shard
+    MapReduceResultsIterator(const std::vector<map_reduce_shard_results_ptr>& shardResults, size_type skip, size_type limit, bool descending);
+    
     const_reference Next();
 
 private:    
     
-    const MapReduceResults& results_;
-    const MapReduceResults::const_iterator begin_;
-    const MapReduceResults::const_iterator end_;
-    const bool empty_;
-    const MapReduceResults::const_iterator ibegin_;
-    const MapReduceResults::const_iterator iend_;
+    using range_type = std::pair<MapReduceShardResults::const_iterator, MapReduceShardResults::const_iterator>;
+    
+    const_reference NextMerged();
+    void MakeHeap();
+    bool Compare(const range_type& a, const range_type& b) const;
+    
+    static bool IsMerged(const MapReduceResults& results);
+    
+    const bool merge_;
+    MapReduceResults::const_iterator begin_;
+    MapReduceResults::const_iterator end_;
+    bool empty_;
+    MapReduceResults::const_iterator ibegin_;
+    MapReduceResults::const_iterator iend_;
     MapReduceResults::const_iterator iter_;
     const int direction_;
+    
+    std::vector<range_type> heap_;
+    size_type skip_;
+    size_type remaining_;
+    
     const MapReduceResults::value_type null_{nullptr};
 };
 
@@ -6,6 +6,7 @@
 
 #include <algorithm>
 #include <cstring>
+#include <string>
 
 MapReduceShardResults::MapReduceShardResults(map_reduce_result_array_ptr results,
         size_type limit, map_reduce_query_key_ptr startKey, map_reduce_query_key_ptr endKey, 
@@ -18,30 +19,15 @@ MapReduceShardResults::MapReduceShardResults(map_reduce_result_array_ptr results
         std::swap(startKey, endKey);
     }
     
-    // TODO: scan for next non-matching item
+    // an exclusive start begins after the key and an inclusive end finishes after it
     if (!!startKey) {
-        startIndex_ = FindResult(*results_, startKey);
-        if (startIndex_ & FindMissedFlag) {
-            startIndex_ = ~startIndex_;
-        } else {
-            auto inclusiveStart = descending_ ? inclusiveEnd_ : true;
-            if (!inclusiveStart) {
-                ++startIndex_;
-            }
-        }
+        auto inclusiveStart = descending_ ? inclusiveEnd_ : true;
+        startIndex_ = FindResult(*results_, startKey, !inclusiveStart);
     }
     
-    // TODO: scan for next non-matching item
     if (!!endKey) {
-        endIndex_ = FindResult(*results_, endKey);
-        if (endIndex_ & FindMissedFlag) {
-            endIndex_ = ~endIndex_;
-        } else {
-            auto inclusiveEnd = !descending_ ? inclusiveEnd_ : true;
-            if (inclusiveEnd) {
-                ++endIndex_;
-            }
-        }
+        auto inclusiveEnd = !descending_ ? inclusiveEnd_ : true;
+        endIndex_ = FindResult(*results_, endKey, inclusiveEnd);
     }    
     
     if (!descending_ && endIndex_ < startIndex_) {
@@ -67,43 +53,55 @@ MapReduceShardResults::size_type MapReduceShardResults::TotalRows() const {
     return results_->size();
 }
 
-MapReduceShardResults::size_type MapReduceShardResults::FindResult(const MapReduceResultArray& results, const map_reduce_query_key_ptr key) {
-    const auto size = results.size();
+MapReduceShardResults::size_type MapReduceShardResults::FindResult(const MapReduceResultArray& results, const map_reduce_query_key_ptr key, bool after) {
+    // the id is only compared when the query key has one, so a key without an id
+    // is before or after all of the rows with the same key
+    std::string queryKey;
+    MapReduceResultComparers::AppendCollationKey(queryKey, key->GetKeyArray(), MapReduceQueryKey::KeyIndex);
+    auto keyId = key->getId();
+    auto compareId = keyId && keyId[0] != '\0';
+    if (compareId) {
+        queryKey += keyId;
+    }
     
-    if (size == 0) {
-        return ~0;
-    } else {
-        size_type min = 0;
-        size_type mid = 0;
-        size_type max = size - 1;
-        auto keyId = key->getId();
-
-        while (min <= max) {
-            mid = ((max - min) / 2) + min;
-            
-            auto result = results[mid];
-            auto diff = MapReduceResultComparers::CompareField(0, key->GetKeyArray(), result->getResultArray());
-            if (diff == 0) {                
-                if (keyId && keyId[0] != '\0') {
-                    diff = std::strcmp(keyId, result->getId());
-                }
-            }
-
-            if (diff == 0) {
-                return mid;
-            } else if (diff < 0) {
-                if (mid == 0) {
-                    break;
-                }
-                
-                max = mid - 1;
-            } else {
-                min = mid + 1;
-            }
-        }
+    auto compare = [&](const map_reduce_result_ptr& result) {
+        return MapReduceResult::CompareCollationKeys(result->getCollationKey(), compareId ? result->getCollationKeyLength() : result->getCollationKeySize(), 
+            queryKey.data(), queryKey.size());
+    };
+    
+    auto iter = std::partition_point(results.cbegin(), results.cend(), [&](const map_reduce_result_ptr& result) {
+        auto diff = compare(result);
+        return diff < 0 || (after && diff == 0);
+    });
+    
+    return std::distance(results.cbegin(), iter);
+}
 
-        return ~min;
+std::vector<MapReduceShardResults::range_type> MapReduceShardResults::FindKeys(const MapReduceResultArray& results, const std::vector<std::string>& sortedKeys) {
+    std::vector<range_type> ranges;
+    ranges.reserve(sortedKeys.size());
+    
+    // only the key part of the row's collation key is compared
+    auto compare = [](const map_reduce_result_ptr& result, const std::string& key) {
+        return MapReduceResult::CompareCollationKeys(result->getCollationKey(), result->getCollationKeySize(), key.data(), key.size());
+    };
+    
+    auto begin = results.cbegin();
+    const auto end = results.cend();
+    for (const auto& key : sortedKeys) {
+        auto first = std::lower_bound(begin, end, key, [&](const map_reduce_result_ptr& result, const std::string& key) { 
+            return compare(result, key) < 0; 
+        });
+        
+        auto last = std::upper_bound(first, end, key, [&](const std::string& key, const map_reduce_result_ptr& result) { 
+            return compare(result, key) > 0; 
+        });
+        
+        ranges.emplace_back(first, last);
+        begin = last;
     }
+    
+    return ranges;
 }
 
 MapReduceShardResults::const_iterator MapReduceShardResults::cbegin() const {
@@ -20,6 +20,9 @@
 #define MAP_REDUCE_SHARD_RESULTS_H
 
 #include <limits>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "types.h"
 #include "document_collection.h"
@@ -29,6 +32,7 @@ class MapReduceShardResults final {
 public:
     using const_iterator = map_reduce_result_array_ptr::element_type::const_iterator;
     using size_type = DocumentCollection::size_type;
+    using range_type = std::pair<const_iterator, const_iterator>;
     
     MapReduceShardResults(map_reduce_result_array_ptr results, size_type limit, map_reduce_query_key_ptr startKey, map_reduce_query_key_ptr endKey, bool inclusiveEnd, bool descending);
     
@@ -38,14 +42,17 @@ public:
     
     map_reduce_result_array_ptr SourceResults() const;
     
+    // finds the rows of each of the sorted collation keys, each search starts
+    // after the rows of the previous key
+    static std::vector<range_type> FindKeys(const MapReduceResultArray& results, const std::vector<std::string>& sortedKeys);
+    
     const_iterator cbegin() const;
     const_iterator cend() const;
     
 private:
     
-    const size_type FindMissedFlag = ~(std::numeric_limits<size_type>::max() / 2);
-    
-    static size_type FindResult(const MapReduceResultArray& results, const map_reduce_query_key_ptr key);
+    // the index of the first row after the key, or the first row which isn't before it
+    static size_type FindResult(const MapReduceResultArray& results, const map_reduce_query_key_ptr key, bool after);
     
     static size_type Subtract(size_type, size_type);
     
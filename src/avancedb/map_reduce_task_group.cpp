@@ -0,0 +1,113 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "map_reduce_task_group.h"
+
+#include <boost/make_shared.hpp>
+
+#include "map_reduce_thread_pool.h"
+
+MapReduceTaskGroup::MapReduceTaskGroup(MapReduceThreadPool& threadPool, bool callerExecutes) :
+        MapReduceTaskGroup([&threadPool](const task_function& task) { threadPool.Post(task); }, callerExecutes) {
+    
+}
+
+MapReduceTaskGroup::MapReduceTaskGroup(const post_function& post, bool callerExecutes) :
+        post_(post), callerExecutes_(callerExecutes), state_(boost::make_shared<State>()) {
+    state_->pending_ = 0;
+}
+
+MapReduceTaskGroup::~MapReduceTaskGroup() {
+    // tasks may still reference the caller's stack if Wait wasn't reached
+    std::unique_lock<std::mutex> lock{state_->mtx_};
+    state_->done_.wait(lock, [&]() { return state_->pending_ == 0; });
+}
+
+void MapReduceTaskGroup::Run(const task_function& task) {
+    {
+        std::lock_guard<std::mutex> lock{state_->mtx_};
+        state_->tasks_.push_back(task);
+        ++state_->pending_;
+    }
+
+    // the worker picks up whichever task is next, which may already have been run by the caller
+    auto state = state_;
+    post_([state]() { RunNext(state); });
+}
+
+void MapReduceTaskGroup::Wait() {
+    if (callerExecutes_) {
+        while (RunNext(state_)) {
+
+        }
+    }
+
+    std::unique_lock<std::mutex> lock{state_->mtx_};
+    state_->done_.wait(lock, [&]() { return state_->pending_ == 0; });
+
+    auto ex = state_->exception_;
+    state_->exception_ = nullptr;
+    lock.unlock();
+
+    if (ex) {
+        std::rethrow_exception(ex);
+    }
+}
+
+bool MapReduceTaskGroup::WaitUntil(const std::chrono::steady_clock::time_point& deadline) {
+    if (callerExecutes_) {
+        while (RunNext(state_)) {
+
+        }
+    }
+
+    std::unique_lock<std::mutex> lock{state_->mtx_};
+    return state_->done_.wait_until(lock, deadline, [&]() { return state_->pending_ == 0; });
+}
+
+bool MapReduceTaskGroup::RunNext(const state_ptr& state) {
+    task_function task;
+
+    {
+        std::lock_guard<std::mutex> lock{state->mtx_};
+        if (state->tasks_.empty()) {
+            return false;
+        }
+
+        task = std::move(state->tasks_.front());
+        state->tasks_.pop_front();
+    }
+
+    std::exception_ptr ex;
+    try {
+        task();
+    } catch (...) {
+        ex = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> lock{state->mtx_};
+    if (ex && !state->exception_) {
+        state->exception_ = ex;
+    }
+
+    if (--state->pending_ == 0) {
+        state->done_.notify_all();
+    }
+
+    return true;
+}
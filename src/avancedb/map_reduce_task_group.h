@@ -0,0 +1,77 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_REDUCE_TASK_GROUP_H
+#define MAP_REDUCE_TASK_GROUP_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <chrono>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+class MapReduceThreadPool;
+
+// Runs a set of tasks on a thread pool, by default the map/reduce thread pool, and waits for all of them to finish
+class MapReduceTaskGroup final : private boost::noncopyable {
+public:
+    using task_function = std::function<void()>;
+    using post_function = std::function<void(const task_function&)>;
+
+    // when callerExecutes is set the waiting thread runs any tasks which haven't started yet,
+    // so a task which uses the pool thread's runtime may only be waited on from a pool thread,
+    // where it runs on the waiting thread's own runtime
+    MapReduceTaskGroup(MapReduceThreadPool& threadPool, bool callerExecutes);
+    
+    // post hands each task to another pool's threads
+    MapReduceTaskGroup(const post_function& post, bool callerExecutes);
+    ~MapReduceTaskGroup();
+
+    void Run(const task_function& task);
+
+    // rethrows the first exception thrown by a task
+    void Wait();
+    
+    // returns false if tasks are still running at the deadline, exceptions are left for Wait
+    bool WaitUntil(const std::chrono::steady_clock::time_point& deadline);
+
+private:
+
+    struct State final {
+        std::mutex mtx_;
+        std::condition_variable done_;
+        std::deque<task_function> tasks_;
+        std::size_t pending_;
+        std::exception_ptr exception_;
+    };
+
+    using state_ptr = boost::shared_ptr<State>;
+
+    static bool RunNext(const state_ptr& state);
+
+    const post_function post_;
+    const bool callerExecutes_;
+    const state_ptr state_;
+};
+
+#endif	/* MAP_REDUCE_TASK_GROUP_H */
+
@@ -20,6 +20,8 @@
 
 #include "config.h"
 #include "set_thread_name.h"
+#include "map_reduce_function_cache.h"
+#include "map_reduce_cancellation.h"
 
 MapReduceThreadPool::map_reduce_thread_pool_ptr mapReduceThreadPool_;
 
@@ -28,6 +30,10 @@ MapReduceThreadPool::MapReduceThreadPool(std::uint32_t jsapiHeapSize, bool enabl
     
 }
 
+MapReduceThreadPool::~MapReduceThreadPool() {
+    
+}
+
 MapReduceThreadPool::map_reduce_thread_pool_ptr MapReduceThreadPool::Start(std::uint32_t jsapiHeapSize, bool enableBaselineCompiler, bool enableIonCompiler) {
     auto threadPool = boost::make_shared<map_reduce_thread_pool_ptr::element_type>(jsapiHeapSize, enableBaselineCompiler, enableIonCompiler);
 
@@ -35,15 +41,19 @@ MapReduceThreadPool::map_reduce_thread_pool_ptr MapReduceThreadPool::Start(std::
     threadPoolOptions.threads_count = Config::GetCPUCount() * Config::MapReduce::GetCPUMultiplier();
 
     threadPool->threadPoolRuntimes_.resize(threadPoolOptions.threads_count);
+    threadPool->threadPoolFunctionCaches_.resize(threadPoolOptions.threads_count);
 
     threadPoolOptions.onStart = [=](size_t id){
         SetThreadName::Set("MapReduceWorker");
 
         auto rt = new rs::jsapi::Runtime(jsapiHeapSize, enableBaselineCompiler, enableIonCompiler);
         threadPool->threadPoolRuntimes_[id].reset(rt);
+        JS_SetInterruptCallback(JS_GetRuntime(*rt), &MapReduceThreadPool::InterruptCallback);
+        threadPool->threadPoolFunctionCaches_[id].reset(new MapReduceFunctionCache{*rt, Config::MapReduce::GetFunctionCacheSize()});
     };
 
     threadPoolOptions.onStop = [=](size_t id) {
+        threadPool->threadPoolFunctionCaches_[id].reset();
         threadPool->threadPoolRuntimes_[id].release();
     };
     
@@ -62,7 +72,41 @@ void MapReduceThreadPool::Stop() {
     mapReduceThreadPool_.reset();
 }
 
+void MapReduceThreadPool::Interrupt() {
+    for (const auto& rt : threadPoolRuntimes_) {
+        if (!!rt) {
+            JS_RequestInterruptCallback(JS_GetRuntime(*rt));
+        }
+    }
+}
+
+bool MapReduceThreadPool::InterruptCallback(JSContext* cx) {
+    // returning false terminates the running script without raising an exception
+    return !MapReduceCancellation::IsCurrentCancelled();
+}
+
 rs::jsapi::Runtime& MapReduceThreadPool::GetThreadRuntime() {
     auto id = Worker::getWorkerIdForCurrentThread();
     return *(threadPoolRuntimes_[id]);
-}
\ No newline at end of file
+}
+
+MapReduceFunctionCache& MapReduceThreadPool::GetThreadFunctionCache() {
+    auto id = Worker::getWorkerIdForCurrentThread();
+    return *(threadPoolFunctionCaches_[id]);
+}
+
+std::uint64_t MapReduceThreadPool::GetFunctionCacheHits() const {
+    std::uint64_t hits = 0;
+    for (const auto& cache : threadPoolFunctionCaches_) {
+        hits += !!cache ? cache->Hits() : 0;
+    }
+    return hits;
+}
+
+std::uint64_t MapReduceThreadPool::GetFunctionCacheMisses() const {
+    std::uint64_t misses = 0;
+    for (const auto& cache : threadPoolFunctionCaches_) {
+        misses += !!cache ? cache->Misses() : 0;
+    }
+    return misses;
+}
@@ -28,12 +28,15 @@
 
 #include "thread_pool.hpp"
 
+class MapReduceFunctionCache;
+
 class MapReduceThreadPool final : public boost::enable_shared_from_this<MapReduceThreadPool> {    
 public:
     using map_reduce_thread_pool_ptr = boost::shared_ptr<MapReduceThreadPool>;
     
     MapReduceThreadPool(const MapReduceThreadPool&) = delete;
     MapReduceThreadPool& operator=(const MapReduceThreadPool&) = delete;    
+    ~MapReduceThreadPool();
     
     static map_reduce_thread_pool_ptr Start(std::uint32_t jsapiHeapSize, bool enableBaselineCompiler, bool enableIonCompiler);
     static map_reduce_thread_pool_ptr Get();
@@ -45,15 +48,25 @@ public:
         threadPool_->post(handler);
     }   
     
+    // requests an interrupt of each thread's runtime, scripts running for a cancelled query are stopped
+    void Interrupt();
+    
     rs::jsapi::Runtime& GetThreadRuntime();
+    MapReduceFunctionCache& GetThreadFunctionCache();
+    
+    std::uint64_t GetFunctionCacheHits() const;
+    std::uint64_t GetFunctionCacheMisses() const;
     
 private:
     friend map_reduce_thread_pool_ptr boost::make_shared<map_reduce_thread_pool_ptr::element_type>(std::uint32_t&, bool&, bool&);
     
     MapReduceThreadPool(std::uint32_t jsapiHeapSize, bool enableBaselineCompiler, bool enableIonCompiler);
+    
+    static bool InterruptCallback(JSContext* cx);
 
     rs::jsapi::Runtime defaultRuntime_;
     std::vector<std::unique_ptr<rs::jsapi::Runtime>> threadPoolRuntimes_;
+    std::vector<std::unique_ptr<MapReduceFunctionCache>> threadPoolFunctionCaches_;
     std::unique_ptr<ThreadPool> threadPool_;
 };
 
@@ -0,0 +1,166 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "map_reduce_view.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "document.h"
+#include "map_reduce_result.h"
+#include "map_reduce_result_array.h"
+
+MapReduceView::MapReduceView(document_ptr designDoc, const MapReduce::MapReduceTask& task, unsigned shards) :
+        designDoc_(designDoc), task_(task), updateSeq_(0), shards_(shards),
+        shardPositions_(shards, 0), shardCapacities_(shards, 0) {
+
+}
+
+map_reduce_view_ptr MapReduceView::Create(document_ptr designDoc, const MapReduce::MapReduceTask& task, unsigned shards) {
+    return boost::make_shared<map_reduce_view_ptr::element_type>(designDoc, task, shards);
+}
+
+document_ptr MapReduceView::DesignDocument() const {
+    return designDoc_;
+}
+
+const MapReduce::MapReduceTask& MapReduceView::Task() const {
+    return task_;
+}
+
+sequence_type MapReduceView::UpdateSequence() const {
+    return updateSeq_;
+}
+
+void MapReduceView::SetUpdateSequence(sequence_type updateSequence) {
+    updateSeq_ = updateSequence;
+}
+
+MapReduceView::shard_array MapReduceView::Shards() const {
+    return shards_;
+}
+
+void MapReduceView::Refresh(unsigned index, document_collection_ptr coll, const map_function& map) {
+    auto& shard = shards_[index];
+    auto& position = shardPositions_[index];
+    
+    // the shard follows the collection's change log, once the log has moved on without
+    // it the shard is mapped again from a snapshot
+    std::vector<DocumentCollection::Change> changes;
+    if (!shard || !coll->changes(position, changes)) {
+        auto docs = coll->snapshot(position);
+        shard = map(GetMappedDocuments(*docs));
+        shardCapacities_[index] = shard->arena_capacity();
+        return;
+    }
+    
+    if (changes.empty()) {
+        return;
+    }
+    
+    // the rows of every replaced or erased document are dropped along with the rows of
+    // the current documents which are mapped again, a document found here may be newer
+    // than the log but it has its own change so the next refresh maps it again too
+    std::vector<const Document*> staleDocs;
+    std::vector<const char*> ids;
+    for (const auto& change : changes) {
+        if (!!change.replaced_) {
+            staleDocs.push_back(change.replaced_);
+        }
+        
+        ids.push_back(change.id_.c_str());
+    }
+    
+    std::sort(ids.begin(), ids.end(), [](const char* a, const char* b) { return std::strcmp(a, b) < 0; });
+    ids.erase(std::unique(ids.begin(), ids.end(), [](const char* a, const char* b) { return std::strcmp(a, b) == 0; }), ids.end());
+    
+    auto changedDocs = boost::make_shared<document_array>();
+    for (auto id : ids) {
+        auto doc = coll->find(id);
+        if (!!doc) {
+            staleDocs.push_back(doc.get());
+            if (!IsDesignDocument(id)) {
+                changedDocs->push_back(doc);
+            }
+        }
+    }
+    
+    std::sort(staleDocs.begin(), staleDocs.end());
+    
+    auto changedResults = map(changedDocs);
+    auto results = boost::make_shared<map_reduce_result_array_ptr::element_type>(shard->size() + changedResults->size());
+    
+    for (auto iter = shard->cbegin(), end = shard->cend(); iter != end; ++iter) {
+        if (!std::binary_search(staleDocs.cbegin(), staleDocs.cend(), (*iter)->getDoc())) {
+            results->push_back(*iter);
+        }
+    }
+    
+    auto currentRows = results->size();
+    for (auto iter = changedResults->cbegin(), end = changedResults->cend(); iter != end; ++iter) {
+        results->push_back(*iter);
+    }
+    
+    std::inplace_merge(results->begin(), results->begin() + currentRows, results->end(),
+        [](const map_reduce_result_ptr& a, const map_reduce_result_ptr& b) {
+            return MapReduceResult::Less(a, b);
+        });
+    
+    // existing readers keep the previous shard and its arenas alive
+    results->add_source(shard);
+    results->add_source(changedResults);
+    
+    // stale rows and the unused slots of each refresh are only released with their
+    // arena, so once the arenas hold twice the slots of the last full map or of the
+    // current rows the shard is mapped again from scratch
+    if (results->arena_capacity() > 2 * std::max(shardCapacities_[index], results->size())) {
+        auto docs = coll->snapshot(position);
+        results = map(GetMappedDocuments(*docs));
+        shardCapacities_[index] = results->arena_capacity();
+    }
+    
+    shard = results;
+}
+
+void MapReduceView::lock() {
+    mtx_.lock();
+}
+
+void MapReduceView::unlock() {
+    mtx_.unlock();
+}
+
+bool MapReduceView::IsDesignDocument(const document_ptr& doc) {
+    return IsDesignDocument(doc->getId());
+}
+
+bool MapReduceView::IsDesignDocument(const char* id) {
+    return std::strncmp(id, "_design/", 8) == 0;
+}
+
+document_array_ptr MapReduceView::GetMappedDocuments(const document_array& docs) {
+    auto mappedDocs = boost::make_shared<document_array>();
+    mappedDocs->reserve(docs.size());
+    for (const auto& doc : docs) {
+        if (!IsDesignDocument(doc)) {
+            mappedDocs->push_back(doc);
+        }
+    }
+    
+    return mappedDocs;
+}
@@ -0,0 +1,76 @@
+/*
+ *  AvanceDB - an in-memory database similar to Apache CouchDB
+ *  Copyright (C) 2015 Ripcord Software
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_REDUCE_VIEW_H
+#define MAP_REDUCE_VIEW_H
+
+#include <vector>
+#include <functional>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/make_shared.hpp>
+
+#include "types.h"
+#include "document_collection.h"
+#include "map_reduce.h"
+#include "map_reduce_result_array.h"
+
+class MapReduceView final : private boost::noncopyable {
+public:
+    using map_function = std::function<map_reduce_result_array_ptr(const document_array_ptr&)>;
+    using shard_array = std::vector<map_reduce_result_array_ptr>;
+
+    static map_reduce_view_ptr Create(document_ptr designDoc, const MapReduce::MapReduceTask& task, unsigned shards);
+
+    document_ptr DesignDocument() const;
+    const MapReduce::MapReduceTask& Task() const;
+
+    sequence_type UpdateSequence() const;
+    void SetUpdateSequence(sequence_type updateSequence);
+
+    shard_array Shards() const;
+
+    void Refresh(unsigned index, document_collection_ptr coll, const map_function& map);
+
+    void lock();
+    void unlock();
+
+private:
+
+    friend map_reduce_view_ptr boost::make_shared<map_reduce_view_ptr::element_type>(document_ptr&, const MapReduce::MapReduceTask&, unsigned&);
+
+    MapReduceView(document_ptr designDoc, const MapReduce::MapReduceTask& task, unsigned shards);
+
+    static bool IsDesignDocument(const document_ptr& doc);
+    static bool IsDesignDocument(const char* id);
+    static document_array_ptr GetMappedDocuments(const document_array& docs);
+
+    const document_ptr designDoc_;
+    const MapReduce::MapReduceTask task_;
+
+    sequence_type updateSeq_;
+    shard_array shards_;
+    std::vector<DocumentCollection::size_type> shardPositions_;
+    std::vector<MapReduceResultArray::size_type> shardCapacities_;
+
+    boost::mutex mtx_;
+};
+
+#endif	/* MAP_REDUCE_VIEW_H */
+
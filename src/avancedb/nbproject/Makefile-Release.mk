@@ -52,14 +52,21 @@ OBJECTFILES= \
 	${OBJECTDIR}/json_stream.o \
 	${OBJECTDIR}/main.o \
 	${OBJECTDIR}/map_reduce.o \
+	${OBJECTDIR}/map_reduce_cancellation.o \
+	${OBJECTDIR}/map_reduce_function_cache.o \
+	${OBJECTDIR}/map_reduce_native_map.o \
+	${OBJECTDIR}/map_reduce_native_reducer.o \
 	${OBJECTDIR}/map_reduce_query_key.o \
 	${OBJECTDIR}/map_reduce_result.o \
+	${OBJECTDIR}/map_reduce_result_arena.o \
 	${OBJECTDIR}/map_reduce_result_array.o \
 	${OBJECTDIR}/map_reduce_result_comparers.o \
 	${OBJECTDIR}/map_reduce_results.o \
 	${OBJECTDIR}/map_reduce_results_iterator.o \
 	${OBJECTDIR}/map_reduce_shard_results.o \
+	${OBJECTDIR}/map_reduce_task_group.o \
 	${OBJECTDIR}/map_reduce_thread_pool.o \
+	${OBJECTDIR}/map_reduce_view.o \
 	${OBJECTDIR}/post_all_documents_options.o \
 	${OBJECTDIR}/rest_config.o \
 	${OBJECTDIR}/rest_exceptions.o \
@@ -199,6 +206,26 @@ ${OBJECTDIR}/map_reduce.o: map_reduce.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce.o map_reduce.cpp
 
+${OBJECTDIR}/map_reduce_cancellation.o: map_reduce_cancellation.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_cancellation.o map_reduce_cancellation.cpp
+
+${OBJECTDIR}/map_reduce_function_cache.o: map_reduce_function_cache.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_function_cache.o map_reduce_function_cache.cpp
+
+${OBJECTDIR}/map_reduce_native_map.o: map_reduce_native_map.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_native_map.o map_reduce_native_map.cpp
+
+${OBJECTDIR}/map_reduce_native_reducer.o: map_reduce_native_reducer.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_native_reducer.o map_reduce_native_reducer.cpp
+
 ${OBJECTDIR}/map_reduce_query_key.o: map_reduce_query_key.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
@@ -209,6 +236,11 @@ ${OBJECTDIR}/map_reduce_result.o: map_reduce_result.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_result.o map_reduce_result.cpp
 
+${OBJECTDIR}/map_reduce_result_arena.o: map_reduce_result_arena.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_result_arena.o map_reduce_result_arena.cpp
+
 ${OBJECTDIR}/map_reduce_result_array.o: map_reduce_result_array.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
@@ -234,11 +266,21 @@ ${OBJECTDIR}/map_reduce_shard_results.o: map_reduce_shard_results.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_shard_results.o map_reduce_shard_results.cpp
 
+${OBJECTDIR}/map_reduce_task_group.o: map_reduce_task_group.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_task_group.o map_reduce_task_group.cpp
+
 ${OBJECTDIR}/map_reduce_thread_pool.o: map_reduce_thread_pool.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_thread_pool.o map_reduce_thread_pool.cpp
 
+${OBJECTDIR}/map_reduce_view.o: map_reduce_view.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_view.o map_reduce_view.cpp
+
 ${OBJECTDIR}/post_all_documents_options.o: post_all_documents_options.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
@@ -550,6 +592,58 @@ ${OBJECTDIR}/map_reduce_nomain.o: ${OBJECTDIR}/map_reduce.o map_reduce.cpp
 	    ${CP} ${OBJECTDIR}/map_reduce.o ${OBJECTDIR}/map_reduce_nomain.o;\
 	fi
 
+${OBJECTDIR}/map_reduce_cancellation_nomain.o: ${OBJECTDIR}/map_reduce_cancellation.o map_reduce_cancellation.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_cancellation.o`; \
+	if (echo "$$NMOUTPUT" | ${GREP} '|main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T _main$$'); \
+	then  \
+	    ${RM} "$@.d";\
+	    $(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -Dmain=__nomain -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_cancellation_nomain.o map_reduce_cancellation.cpp;\
+	else  \
+	    ${CP} ${OBJECTDIR}/map_reduce_cancellation.o ${OBJECTDIR}/map_reduce_cancellation_nomain.o;\
+	fi
+
+${OBJECTDIR}/map_reduce_function_cache_nomain.o: ${OBJECTDIR}/map_reduce_function_cache.o map_reduce_function_cache.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_function_cache.o`; \
+	if (echo "$$NMOUTPUT" | ${GREP} '|main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T _main$$'); \
+	then  \
+	    ${RM} "$@.d";\
+	    $(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -Dmain=__nomain -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_function_cache_nomain.o map_reduce_function_cache.cpp;\
+	else  \
+	    ${CP} ${OBJECTDIR}/map_reduce_function_cache.o ${OBJECTDIR}/map_reduce_function_cache_nomain.o;\
+	fi
+
+${OBJECTDIR}/map_reduce_native_map_nomain.o: ${OBJECTDIR}/map_reduce_native_map.o map_reduce_native_map.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_native_map.o`; \
+	if (echo "$$NMOUTPUT" | ${GREP} '|main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T _main$$'); \
+	then  \
+	    ${RM} "$@.d";\
+	    $(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -Dmain=__nomain -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_native_map_nomain.o map_reduce_native_map.cpp;\
+	else  \
+	    ${CP} ${OBJECTDIR}/map_reduce_native_map.o ${OBJECTDIR}/map_reduce_native_map_nomain.o;\
+	fi
+
+${OBJECTDIR}/map_reduce_native_reducer_nomain.o: ${OBJECTDIR}/map_reduce_native_reducer.o map_reduce_native_reducer.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_native_reducer.o`; \
+	if (echo "$$NMOUTPUT" | ${GREP} '|main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T _main$$'); \
+	then  \
+	    ${RM} "$@.d";\
+	    $(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -Dmain=__nomain -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_native_reducer_nomain.o map_reduce_native_reducer.cpp;\
+	else  \
+	    ${CP} ${OBJECTDIR}/map_reduce_native_reducer.o ${OBJECTDIR}/map_reduce_native_reducer_nomain.o;\
+	fi
+
 ${OBJECTDIR}/map_reduce_query_key_nomain.o: ${OBJECTDIR}/map_reduce_query_key.o map_reduce_query_key.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_query_key.o`; \
@@ -576,6 +670,19 @@ ${OBJECTDIR}/map_reduce_result_nomain.o: ${OBJECTDIR}/map_reduce_result.o map_re
 	    ${CP} ${OBJECTDIR}/map_reduce_result.o ${OBJECTDIR}/map_reduce_result_nomain.o;\
 	fi
 
+${OBJECTDIR}/map_reduce_result_arena_nomain.o: ${OBJECTDIR}/map_reduce_result_arena.o map_reduce_result_arena.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_result_arena.o`; \
+	if (echo "$$NMOUTPUT" | ${GREP} '|main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T _main$$'); \
+	then  \
+	    ${RM} "$@.d";\
+	    $(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -Dmain=__nomain -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_result_arena_nomain.o map_reduce_result_arena.cpp;\
+	else  \
+	    ${CP} ${OBJECTDIR}/map_reduce_result_arena.o ${OBJECTDIR}/map_reduce_result_arena_nomain.o;\
+	fi
+
 ${OBJECTDIR}/map_reduce_result_array_nomain.o: ${OBJECTDIR}/map_reduce_result_array.o map_reduce_result_array.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_result_array.o`; \
@@ -641,6 +748,19 @@ ${OBJECTDIR}/map_reduce_shard_results_nomain.o: ${OBJECTDIR}/map_reduce_shard_re
 	    ${CP} ${OBJECTDIR}/map_reduce_shard_results.o ${OBJECTDIR}/map_reduce_shard_results_nomain.o;\
 	fi
 
+${OBJECTDIR}/map_reduce_task_group_nomain.o: ${OBJECTDIR}/map_reduce_task_group.o map_reduce_task_group.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_task_group.o`; \
+	if (echo "$$NMOUTPUT" | ${GREP} '|main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T _main$$'); \
+	then  \
+	    ${RM} "$@.d";\
+	    $(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -Dmain=__nomain -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_task_group_nomain.o map_reduce_task_group.cpp;\
+	else  \
+	    ${CP} ${OBJECTDIR}/map_reduce_task_group.o ${OBJECTDIR}/map_reduce_task_group_nomain.o;\
+	fi
+
 ${OBJECTDIR}/map_reduce_thread_pool_nomain.o: ${OBJECTDIR}/map_reduce_thread_pool.o map_reduce_thread_pool.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_thread_pool.o`; \
@@ -654,6 +774,19 @@ ${OBJECTDIR}/map_reduce_thread_pool_nomain.o: ${OBJECTDIR}/map_reduce_thread_poo
 	    ${CP} ${OBJECTDIR}/map_reduce_thread_pool.o ${OBJECTDIR}/map_reduce_thread_pool_nomain.o;\
 	fi
 
+${OBJECTDIR}/map_reduce_view_nomain.o: ${OBJECTDIR}/map_reduce_view.o map_reduce_view.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	@NMOUTPUT=`${NM} ${OBJECTDIR}/map_reduce_view.o`; \
+	if (echo "$$NMOUTPUT" | ${GREP} '|main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T main$$') || \
+	   (echo "$$NMOUTPUT" | ${GREP} 'T _main$$'); \
+	then  \
+	    ${RM} "$@.d";\
+	    $(COMPILE.cc) -O2 -I../../externals/libhttpserver/src/libhttpserver -I../../externals/libjsapi/src/libjsapi -I../../externals/termcolor/include -I../../externals/libscriptobject/src/libscriptobject -I../../externals/libscriptobject/src/libscriptobject_gason -I../../externals/libscriptobject/externals/gason/src -I../../externals/cityhash/src -I../../externals/libjsapi/externals/installed/include/mozjs- -I../../externals/thread-pool-cpp/thread_pool `pkg-config --cflags zlib` -std=c++11  -Dmain=__nomain -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/map_reduce_view_nomain.o map_reduce_view.cpp;\
+	else  \
+	    ${CP} ${OBJECTDIR}/map_reduce_view.o ${OBJECTDIR}/map_reduce_view_nomain.o;\
+	fi
+
 ${OBJECTDIR}/post_all_documents_options_nomain.o: ${OBJECTDIR}/post_all_documents_options.o post_all_documents_options.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	@NMOUTPUT=`${NM} ${OBJECTDIR}/post_all_documents_options.o`; \
@@ -19,12 +19,13 @@
 #include "rest_config.h"
 
 #define REST_CONFIG_QUERY_SERVERS R"({"javascript":"libjsapi"})"
-#define REST_CONFIG_NATIVE_QUERY_SERVERS R"({})"
+#define REST_CONFIG_NATIVE_QUERY_SERVERS R"({"native":"avancedb"})"
 
 const char* RestConfig::getConfig() {
     return 
         R"({)"
         R"("query_servers":)" REST_CONFIG_QUERY_SERVERS
+        R"(,"native_query_servers":)" REST_CONFIG_NATIVE_QUERY_SERVERS
         R"(})";
 }
 
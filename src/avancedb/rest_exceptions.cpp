@@ -59,6 +59,11 @@ static const char* missingDocumentJsonBody = R"({
     "reason": "missing"
 })";
 
+static const char* missingViewJsonBody = R"({
+    "error": "not_found",
+    "reason": "missing_named_view"
+})";
+
 static const char* uuidCountLimitJsonBody = R"({
     "error": "forbidden",
     "reason": "count parameter too large"
@@ -84,6 +89,21 @@ static const char* badLanguageErrorJsonBody = R"({
     "reason": "%s is not a supported map/reduce language"
 })";
 
+static const char* builtInReduceErrorJsonBody = R"({
+    "error": "builtin_reduce_error",
+    "reason": "%s"
+})";
+
+static const char* multiKeyReduceErrorJsonBody = R"({
+    "error": "query_parse_error",
+    "reason": "Multi-key fetches for reduce views must use `group=true`"
+})";
+
+static const char* queryTimeoutErrorJsonBody = R"({
+    "error": "timeout",
+    "reason": "The request could not be processed in a reasonable amount of time."
+})";
+
 static const char* contentType = "application/json";
 
 DatabaseAlreadyExists::DatabaseAlreadyExists() : 
@@ -116,6 +136,11 @@ DocumentMissing::DocumentMissing() :
     
 }
 
+ViewMissing::ViewMissing() :
+    HttpServerException(404, notFoundDescription, missingViewJsonBody, contentType) {
+    
+}
+
 UuidCountLimit::UuidCountLimit() :
     HttpServerException(403, forbiddenDescription, uuidCountLimitJsonBody, contentType) {
     
@@ -139,4 +164,19 @@ CompilationError::CompilationError(const char* msg) :
 BadLanguageError::BadLanguageError(const char* msg) :
     HttpServerException(500, internalServerErrorDescription, (boost::format(badLanguageErrorJsonBody) % JsonHelper::EscapeJsonString(msg)).str(), contentType) {
     
+}
+
+BuiltInReduceError::BuiltInReduceError(const char* msg) :
+    HttpServerException(500, internalServerErrorDescription, (boost::format(builtInReduceErrorJsonBody) % JsonHelper::EscapeJsonString(msg)).str(), contentType) {
+    
+}
+
+MultiKeyReduceError::MultiKeyReduceError() :
+    HttpServerException(400, badRequestDescription, multiKeyReduceErrorJsonBody, contentType) {
+    
+}
+
+QueryTimeoutError::QueryTimeoutError() :
+    HttpServerException(500, internalServerErrorDescription, queryTimeoutErrorJsonBody, contentType) {
+    
 }
\ No newline at end of file
@@ -51,6 +51,11 @@ public:
     DocumentMissing();
 };
 
+class ViewMissing final : public HttpServerException {
+public:
+    ViewMissing();
+};
+
 class UuidCountLimit final : public HttpServerException {
 public:
     UuidCountLimit();
@@ -76,4 +81,19 @@ public:
     BadLanguageError(const char* msg);
 };
 
+class BuiltInReduceError final : public HttpServerException {
+public:
+    BuiltInReduceError(const char* msg);
+};
+
+class MultiKeyReduceError final : public HttpServerException {
+public:
+    MultiKeyReduceError();
+};
+
+class QueryTimeoutError final : public HttpServerException {
+public:
+    QueryTimeoutError();
+};
+
 #endif	/* REST_EXCEPTIONS_H */
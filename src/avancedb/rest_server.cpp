@@ -37,6 +37,8 @@
 #include "map_reduce_result.h"
 #include "map_reduce_results_iterator.h"
 #include "get_view_options.h"
+#include "map_reduce_cancellation.h"
+#include "config.h"
 
 #include "libscriptobject_gason.h"
 
@@ -70,6 +72,7 @@ RestServer::RestServer() {
     AddRoute("POST", REGEX_DBNAME_GROUP "/+_revs_diff", &RestServer::PostDatabaseRevsDiff);
     AddRoute("POST", REGEX_DBNAME_GROUP "/+_ensure_full_commit", &RestServer::PostEnsureFullCommit);
     AddRoute("POST", REGEX_DBNAME_GROUP "/+_temp_view", &RestServer::PostTempView);
+    AddRoute("POST", REGEX_DBNAME_GROUP "/+_design" REGEX_DESIGNID_GROUP "/_view" REGEX_VIEWID_GROUP, &RestServer::PostDesignDocumentView);
     AddRoute("POST", REGEX_DBNAME_GROUP "/{0,}$", &RestServer::PostDatabase);
     
     AddRoute("GET", "/+_active_tasks/{0,}$", &RestServer::GetActiveTasks);
@@ -325,10 +328,23 @@ bool RestServer::GetDesignDocument(rs::httpserver::request_ptr request, const rs
 
 
 bool RestServer::GetDesignDocumentView(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs& args, rs::httpserver::response_ptr response) {
+    auto executed = false;
+    
     auto db = GetDatabase(args);
     if (!!db) {
-        response->setStatusCode(200).setContentType(ContentTypes::Utf8::applicationJson).Send(R"({"offset":0,"rows":[],"total_rows":0})");
-    }    
+        GetViewOptions options{request->getQueryString()};
+        MapReduceCancellation::Scope cancellationScope{MapReduceCancellation::Create(Config::MapReduce::GetQueryTimeout())};
+        
+        auto designId = GetParameter("designid", args);
+        auto viewId = GetParameter("viewid", args);
+        
+        auto results = db->GetDesignDocumentView(options, designId, viewId);
+        SendMapReduceResults(response, results, options.IncludeDocs());
+        
+        executed = true;
+    }
+    
+    return executed;
 }
 
 bool RestServer::PutDocument(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs& args, rs::httpserver::response_ptr response) {
@@ -768,49 +784,108 @@ bool RestServer::PostTempView(rs::httpserver::request_ptr request, const rs::htt
     
     auto db = GetDatabase(args);
     if (!!db) {
-        GetViewOptions options{request->getQueryString()};
-        const auto includeDocs = options.IncludeDocs();
-        
         auto obj = GetJsonBody(request);
         if (!obj || obj->getType("map") != rs::scriptobject::ScriptObjectType::String) {
             throw InvalidJson();
         }
         
+        GetViewOptions options{request->getQueryString(), GetViewKeys(obj)};
+        MapReduceCancellation::Scope cancellationScope{MapReduceCancellation::Create(Config::MapReduce::GetQueryTimeout())};
+        const auto includeDocs = options.IncludeDocs();
+        
         auto results = db->PostTempView(options, obj);        
+        SendMapReduceResults(response, results, includeDocs);
         
-        auto& stream = response->setContentType(ContentTypes::Utf8::applicationJson).getResponseStream();
-        ScriptObjectResponseStream<> objStream{stream};
-        objStream << R"({"offset":)" << results->Offset() << R"(,"total_rows":)" << results->TotalRows() << R"(,"rows":[)";
+        executed = true;
+    }
+    
+    return executed;
+}
 
+bool RestServer::PostDesignDocumentView(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs& args, rs::httpserver::response_ptr response) {
+    auto executed = false;
+    
+    auto db = GetDatabase(args);
+    if (!!db) {
+        auto obj = GetJsonBody(request);
+        if (!obj) {
+            throw InvalidJson();
+        }
+        
+        GetViewOptions options{request->getQueryString(), GetViewKeys(obj)};
+        MapReduceCancellation::Scope cancellationScope{MapReduceCancellation::Create(Config::MapReduce::GetQueryTimeout())};
+        
+        auto designId = GetParameter("designid", args);
+        auto viewId = GetParameter("viewid", args);
+        
+        auto results = db->GetDesignDocumentView(options, designId, viewId);
+        SendMapReduceResults(response, results, options.IncludeDocs());
+        
+        executed = true;
+    }
+    
+    return executed;
+}
+
+script_array_ptr RestServer::GetViewKeys(script_object_ptr obj) {
+    switch (obj->getType("keys")) {
+        case rs::scriptobject::ScriptObjectType::Array:
+            return obj->getArray("keys");
+        case rs::scriptobject::ScriptObjectType::Unknown:
+            return nullptr;
+        default:
+            throw InvalidJson();
+    }
+}
+
+void RestServer::SendMapReduceResults(rs::httpserver::response_ptr response, map_reduce_results_ptr results, bool includeDocs) {
+    auto& stream = response->setContentType(ContentTypes::Utf8::applicationJson).getResponseStream();
+    ScriptObjectResponseStream<> objStream{stream};
+    
+    auto reducedResults = results->ReducedResults();
+    if (!!reducedResults) {
+        objStream << R"({"rows":[)";
+        
         auto prefixComma = false;
-        auto iter = results->Iterator();
-        auto result = iter.Next();
-        while (result) {
-            auto resultObj = result->getResultArray();
-            
+        for (const auto& result : *reducedResults) {
             objStream << (prefixComma ? ',' : ' ');
-            objStream << R"({"id":")" << result->getId() << R"(","key":)";
-            objStream.Serialize(resultObj, MapReduceResult::KeyIndex);
+            objStream << R"({"key":)";
+            objStream.Serialize(result, MapReduceResult::KeyIndex);
             objStream << R"(,"value":)";
-            objStream.Serialize(resultObj, MapReduceResult::ValueIndex);
-            
-            if (includeDocs) {
-                objStream << R"(,"doc":)" << result->getDoc()->getObject();
-            }
-            
+            objStream.Serialize(result, MapReduceResult::ValueIndex);
             objStream << '}';
             prefixComma = true;
-            
-            result = iter.Next();
         }
         
         objStream << "]}";
         objStream.Flush();
+        return;
+    }
+    
+    objStream << R"({"offset":)" << results->Offset() << R"(,"total_rows":)" << results->TotalRows() << R"(,"rows":[)";
+
+    auto prefixComma = false;
+    auto iter = results->Iterator();
+    auto result = iter.Next();
+    while (result) {
+        objStream << (prefixComma ? ',' : ' ');
+        objStream << R"({"id":")" << result->getId() << R"(","key":)";
+        objStream.Serialize(result, MapReduceResult::KeyIndex);
+        objStream << R"(,"value":)";
+        objStream.Serialize(result, MapReduceResult::ValueIndex);
         
-        executed = true;
+        if (includeDocs) {
+            objStream << R"(,"doc":)" << result->getDoc()->getObject();
+        }
+        
+        objStream << '}';
+        prefixComma = true;
+        
+        result = iter.Next();
     }
     
-    return executed;
+    objStream << "]}";
+    objStream.Flush();
 }
 
 bool RestServer::GetConfig(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs&, rs::httpserver::response_ptr response) {
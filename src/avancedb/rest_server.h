@@ -66,6 +66,7 @@ private:
     bool PostEnsureFullCommit(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs&, rs::httpserver::response_ptr response);
     bool PostDatabase(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs&, rs::httpserver::response_ptr response);
     bool PostTempView(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs&, rs::httpserver::response_ptr response);
+    bool PostDesignDocumentView(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs&, rs::httpserver::response_ptr response);
     
     bool DeleteDatabase(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs&, rs::httpserver::response_ptr response);
     bool DeleteDocument(rs::httpserver::request_ptr request, const rs::httpserver::RequestRouter::CallbackArgs&, rs::httpserver::response_ptr response);
@@ -81,6 +82,9 @@ private:
     const char* GetParameter(const char* param, const rs::httpserver::RequestRouter::CallbackArgs&);
     rs::scriptobject::ScriptObjectPtr GetJsonBody(rs::httpserver::request_ptr request, bool useCachedObjectKeys = true);
     
+    static script_array_ptr GetViewKeys(script_object_ptr obj);
+    void SendMapReduceResults(rs::httpserver::response_ptr response, map_reduce_results_ptr results, bool includeDocs);
+    
     rs::httpserver::RequestRouter router_;        
     Databases databases_;
 
@@ -20,6 +20,12 @@
 
 #include <vector>
 #include <cstring>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <memory>
 
 #include <boost/format.hpp>
 
@@ -34,6 +40,9 @@
 #include "../database.h"
 #include "../rest_exceptions.h"
 #include "../post_all_documents_options.h"
+#include "../document_collection.h"
+#include "../map_reduce_thread_pool.h"
+#include "../config.h"
 
 class BasicDatabaseTests : public ::testing::Test {
 protected:
@@ -1133,4 +1142,504 @@ TEST_F(BasicDatabaseTests, test57) {
         auto doc = docs_->getObject(docs_->getCount() - 1 - 100 - i);
         ASSERT_STREQ(doc->getString("_id"), result->getId());
     }
-}
\ No newline at end of file
+}
+
+TEST_F(BasicDatabaseTests, test58) {
+    auto coll = DocumentCollection::Create();
+    for (auto i = 0; i < 10; ++i) {
+        auto obj = docs_->getObject(i);
+        coll->insert(Document::Create(obj->getString("_id"), obj, i + 1));
+    }
+    
+    auto snapshot = coll->snapshot();
+    ASSERT_EQ(10, snapshot->size());
+    ASSERT_EQ(snapshot, coll->snapshot());
+    
+    // a write doesn't change the existing snapshot, the next reader gets a new one
+    auto obj = docs_->getObject(10);
+    coll->insert(Document::Create(obj->getString("_id"), obj, 11));
+    coll->erase((*snapshot)[0]);
+    
+    auto newSnapshot = coll->snapshot();
+    ASSERT_NE(snapshot, newSnapshot);
+    ASSERT_EQ(10, snapshot->size());
+    ASSERT_EQ(10, newSnapshot->size());
+    ASSERT_STREQ(MakeDocId(0).c_str(), (*snapshot)[0]->getId());
+    ASSERT_STREQ(MakeDocId(1).c_str(), (*newSnapshot)[0]->getId());
+    ASSERT_STREQ(MakeDocId(10).c_str(), (*newSnapshot)[9]->getId());
+    
+    // the last write to an id wins, including writes merged by a writer as it unlocks
+    for (auto i = 0; i < 3000; ++i) {
+        auto obj = docs_->getObject(i % 20);
+        auto doc = Document::Create(obj->getString("_id"), obj, 12 + i);
+        boost::lock_guard<DocumentCollection> guard{*coll};
+        coll->insert(doc);
+        if (i % 20 == 3) {
+            coll->erase(doc);
+        }
+    }
+    
+    auto lastSnapshot = coll->snapshot();
+    ASSERT_EQ(19, lastSnapshot->size());
+    ASSERT_EQ(coll->size(), lastSnapshot->size());
+    for (auto i = 0; i < lastSnapshot->size(); ++i) {
+        auto index = i < 3 ? i : i + 1;
+        ASSERT_STREQ(MakeDocId(index).c_str(), (*lastSnapshot)[i]->getId());
+        ASSERT_EQ(12 + 2980 + index, (*lastSnapshot)[i]->getUpdateSequence());
+    }
+}
+
+TEST_F(BasicDatabaseTests, test59) {
+    auto coll = DocumentCollection::Create();
+    for (auto i = 0; i < 100; ++i) {
+        auto obj = docs_->getObject(i);
+        coll->insert(Document::Create(obj->getString("_id"), obj, i + 1));
+    }
+    
+    // the index is searched without the lock and follows writes and erasures
+    auto doc = coll->find(MakeDocId(42).c_str());
+    ASSERT_NE(nullptr, doc);
+    ASSERT_STREQ(MakeDocId(42).c_str(), doc->getId());
+    
+    coll->insert(Document::Create(doc->getId(), doc->getObject(), 101));
+    ASSERT_EQ(101, coll->find(MakeDocId(42).c_str())->getUpdateSequence());
+    
+    coll->erase(doc);
+    ASSERT_EQ(nullptr, coll->find(MakeDocId(42).c_str()));
+    ASSERT_EQ(nullptr, coll->find("missing"));
+    ASSERT_EQ(99, coll->size());
+    
+    auto dbName = "basicdatabasetests59";
+    databases_.AddDatabase(dbName);
+    auto db = databases_.GetDatabase(dbName);
+    db->PostBulkDocuments(docs_, true);
+    
+    // every read finds its document while the documents are being replaced
+    std::atomic<bool> reading{true};
+    std::thread writer{[&]() {
+        while (reading) {
+            db->PostBulkDocuments(docs_, false);
+        }
+    }};
+    
+    const auto readers = 4;
+    std::vector<int> misses(readers);
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < readers; ++i) {
+        threads.emplace_back([&, i]() {
+            for (auto j = 0; j < 5000; ++j) {
+                auto id = MakeDocId((i + j * readers) % docs_->getCount());
+                if (!db->GetDocument(id.c_str(), false)) {
+                    ++misses[i];
+                }
+            }
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    reading = false;
+    writer.join();
+    
+    for (auto i = 0; i < readers; ++i) {
+        ASSERT_EQ(0, misses[i]);
+    }
+    
+    ASSERT_EQ(docs_->getCount(), db->DocCount());
+}
+
+TEST_F(BasicDatabaseTests, DISABLED_benchmark59) {
+    auto dbName = "basicdatabasebenchmark59";
+    databases_.AddDatabase(dbName);
+    auto db = databases_.GetDatabase(dbName);
+    db->PostBulkDocuments(docs_, true);
+    
+    // compare the read latency of document lookups on their own and while documents are written
+    auto benchmark = [&](bool ingest) {
+        const auto readers = 4;
+        const auto reads = 50000;
+        
+        std::atomic<bool> reading{true};
+        std::thread writer{[&]() {
+            while (ingest && reading) {
+                db->PostBulkDocuments(docs_, false);
+            }
+        }};
+        
+        std::vector<std::vector<std::uint64_t>> latencies(readers);
+        std::vector<std::thread> threads;
+        for (auto i = 0; i < readers; ++i) {
+            threads.emplace_back([&, i]() {
+                auto& readerLatencies = latencies[i];
+                readerLatencies.reserve(reads);
+                
+                for (auto j = 0; j < reads; ++j) {
+                    auto id = MakeDocId((i + j * readers) % docs_->getCount());
+                    
+                    auto start = std::chrono::steady_clock::now();
+                    db->GetDocument(id.c_str(), false);
+                    auto elapsed = std::chrono::steady_clock::now() - start;
+                    
+                    readerLatencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+                }
+            });
+        }
+        
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        
+        reading = false;
+        writer.join();
+        
+        std::vector<std::uint64_t> all;
+        for (const auto& readerLatencies : latencies) {
+            all.insert(all.end(), readerLatencies.cbegin(), readerLatencies.cend());
+        }
+        
+        std::sort(all.begin(), all.end());
+        std::cout << "GET p99 " << (ingest ? "with" : "without") << " _bulk_docs: " << all[all.size() * 99 / 100] << " ns" << std::endl;
+    };
+    
+    benchmark(false);
+    benchmark(true);
+}
+
+TEST_F(BasicDatabaseTests, test60) {
+    auto coll = DocumentCollection::Create();
+    
+    // the index grows and reuses erased slots while documents come and go
+    for (auto round = 0; round < 4; ++round) {
+        for (auto i = 0; i < docs_->getCount(); ++i) {
+            auto obj = docs_->getObject(i);
+            auto doc = Document::Create(obj->getString("_id"), obj, round * docs_->getCount() + i + 1);
+            ASSERT_EQ(Document::getIdHash(doc->getId()), doc->getIdHash());
+            
+            coll->insert(doc);
+        }
+        
+        for (auto i = round % 2; i < docs_->getCount(); i += 2) {
+            auto id = MakeDocId(i);
+            coll->erase(coll->find(id.c_str(), Document::getIdHash(id.c_str())));
+        }
+        
+        ASSERT_EQ(docs_->getCount() / 2, coll->size());
+        for (auto i = 0; i < docs_->getCount(); ++i) {
+            auto id = MakeDocId(i);
+            auto doc = coll->find(id.c_str());
+            
+            if (i % 2 == round % 2) {
+                ASSERT_EQ(nullptr, doc);
+            } else {
+                ASSERT_NE(nullptr, doc);
+                ASSERT_STREQ(id.c_str(), doc->getId());
+                ASSERT_EQ(round * docs_->getCount() + i + 1, doc->getUpdateSequence());
+            }
+        }
+    }
+}
+
+TEST_F(BasicDatabaseTests, test61) {
+    auto dbName = "basicdatabasetests61";
+    databases_.AddDatabase(dbName);
+    auto db = databases_.GetDatabase(dbName);
+    db->PostBulkDocuments(docs_, true);
+    
+    rs::scriptobject::utils::ArrayVector ids = { MakeDocId(7).c_str(), "missing", MakeDocId(3).c_str() };
+    rs::scriptobject::utils::ScriptArrayVectorSource idSource{ids};
+    auto keys = rs::scriptobject::ScriptArrayFactory::CreateArray(idSource);
+    
+    rs::httpserver::QueryString qs{""};
+    PostAllDocumentsOptions options{qs, keys};
+    
+    // each write is seen by the next keyed read
+    for (auto i = 0; i < 3; ++i) {
+        DocumentCollection::size_type totalDocs = 0, updateSequence = 0;
+        auto results = db->PostDocuments(options, totalDocs, updateSequence);
+        
+        ASSERT_EQ(db->DocCount(), totalDocs);
+        ASSERT_EQ(db->UpdateSequence(), updateSequence);
+        ASSERT_EQ(3, results->size());
+        ASSERT_EQ(nullptr, (*results)[1]);
+        
+        if (i < 2) {
+            ASSERT_NE(nullptr, (*results)[0]);
+            ASSERT_STREQ(MakeDocId(7).c_str(), (*results)[0]->getId());
+            ASSERT_TRUE(ValidateRevision(i + 1, (*results)[0]));
+        } else {
+            ASSERT_EQ(nullptr, (*results)[0]);
+        }
+        
+        ASSERT_NE(nullptr, (*results)[2]);
+        ASSERT_STREQ(MakeDocId(3).c_str(), (*results)[2]->getId());
+        
+        auto doc = db->GetDocument(MakeDocId(7).c_str(), false);
+        if (i == 0) {
+            auto json = (boost::format(R"({"_id":"%s","_rev":"%s"})") % doc->getId() % doc->getRev()).str();
+            std::vector<char> buffer{json.cbegin(), json.cend()};
+            buffer.push_back('\0');
+            
+            rs::scriptobject::ScriptObjectJsonSource source(buffer.data());
+            db->SetDocument(doc->getId(), rs::scriptobject::ScriptObjectFactory::CreateObject(source, false));
+        } else if (i == 1) {
+            db->DeleteDocument(doc->getId(), doc->getRev());
+        }
+    }
+}
+
+TEST_F(BasicDatabaseTests, test62) {
+    auto dbName = "basicdatabasetests62";
+    databases_.AddDatabase(dbName);
+    auto db = databases_.GetDatabase(dbName);
+    db->PostBulkDocuments(docs_, true);
+    
+    // the writes after the bulk post are overlaid on the last snapshot
+    for (auto id : { MakeDocId(100), MakeDocId(500), MakeDocId(750) }) {
+        auto doc = db->GetDocument(id.c_str(), false);
+        db->DeleteDocument(doc->getId(), doc->getRev());
+    }
+    
+    for (auto id : { MakeDocId(250), MakeDocId(250) + "a", MakeDocId(999) + "a" }) {
+        auto doc = db->GetDocument(id.c_str(), false);
+        auto json = !!doc ? (boost::format(R"({"_id":"%s","_rev":"%s"})") % doc->getId() % doc->getRev()).str() : (boost::format(R"({"_id":"%s"})") % id).str();
+        std::vector<char> buffer{json.cbegin(), json.cend()};
+        buffer.push_back('\0');
+        
+        rs::scriptobject::ScriptObjectJsonSource source(buffer.data());
+        db->SetDocument(id.c_str(), rs::scriptobject::ScriptObjectFactory::CreateObject(source, false));
+    }
+    
+    rs::httpserver::QueryString qs{""};
+    GetAllDocumentsOptions options{qs};
+    DocumentCollection::size_type offset = 0, totalDocs = 0, updateSequence = 0;
+    auto results = db->GetDocuments(options, offset, totalDocs, updateSequence);
+    
+    ASSERT_EQ(db->DocCount(), totalDocs);
+    ASSERT_EQ(totalDocs, results->size());
+    ASSERT_EQ(0, offset);
+    ASSERT_TRUE(std::is_sorted(results->cbegin(), results->cend(), Document::Less{}));
+    ASSERT_TRUE(std::adjacent_find(results->cbegin(), results->cend(), [](const document_ptr& a, const document_ptr& b) { 
+        return std::strcmp(a->getId(), b->getId()) == 0; 
+    }) == results->cend());
+    
+    for (const auto& doc : *results) {
+        ASSERT_STRNE(MakeDocId(100).c_str(), doc->getId());
+        ASSERT_STRNE(MakeDocId(500).c_str(), doc->getId());
+        ASSERT_STRNE(MakeDocId(750).c_str(), doc->getId());
+    }
+    
+    // a page of the merged shards matches the same page of all the rows
+    for (auto query : { "", R"(startkey="00000250")", R"(endkey="00000750"&inclusive_end=false)", R"(startkey="00000250"&endkey="00000750")" }) {
+        for (auto descending : { false, true }) {
+            for (auto page : { "skip=0&limit=100", "skip=95&limit=10", "skip=990&limit=100", "skip=2000&limit=10", "skip=7", "skip=5&limit=0" }) {
+                auto allQuery = (boost::format("%s%sdescending=%s") % query % (query[0] != '\0' ? "&" : "") % (descending ? "true" : "false")).str();
+                auto pageQuery = (boost::format("%s&%s") % allQuery % page).str();
+                
+                rs::httpserver::QueryString allQs{allQuery.c_str()};
+                GetAllDocumentsOptions allOptions{allQs};
+                DocumentCollection::size_type allOffset = 0, allTotalDocs = 0, updateSequence = 0;
+                auto allResults = db->GetDocuments(allOptions, allOffset, allTotalDocs, updateSequence);
+                
+                rs::httpserver::QueryString pageQs{pageQuery.c_str()};
+                GetAllDocumentsOptions pageOptions{pageQs};
+                DocumentCollection::size_type offset = 0, totalDocs = 0;
+                auto results = db->GetDocuments(pageOptions, offset, totalDocs, updateSequence);
+                
+                auto skip = std::min(pageOptions.Skip(), allResults->size());
+                auto limit = std::min(pageOptions.Limit(), allResults->size() - skip);
+                
+                ASSERT_EQ(allTotalDocs, totalDocs);
+                ASSERT_EQ(allOffset + skip, offset);
+                ASSERT_EQ(limit, results->size());
+                for (decltype(limit) i = 0; i < limit; ++i) {
+                    ASSERT_EQ((*allResults)[skip + i], (*results)[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(BasicDatabaseTests, test63) {
+    std::unique_ptr<MapReduceThreadPoolScope> threadPool;
+    if (!MapReduceThreadPool::Get()) {
+        threadPool.reset(new MapReduceThreadPoolScope{Config::SpiderMonkey::GetHeapSize(), Config::SpiderMonkey::GetEnableBaselineCompiler(), Config::SpiderMonkey::GetEnableIonCompiler()});
+    }
+    
+    auto dbName = "basicdatabasetests63";
+    databases_.AddDatabase(dbName);
+    auto db = databases_.GetDatabase(dbName);
+    
+    // the batch repeats every id and has documents without one, the second copy of each
+    // id conflicts with the first since it has no revision
+    std::string json = R"({"docs":[)";
+    for (auto i = 0; i < 200; ++i) {
+        json += (i > 0 ? "," : "") + MakeDocJson(MakeDocId(i % 100)) + R"(,{"lorem":"ipsum"})";
+    }
+    json += R"(]})";
+    
+    std::vector<char> buffer{json.cbegin(), json.cend()};
+    buffer.push_back('\0');
+    
+    rs::scriptobject::ScriptObjectJsonSource source(buffer.data());
+    auto docs = rs::scriptobject::ScriptObjectFactory::CreateObject(source, false)->getArray("docs");
+    
+    auto results = db->PostBulkDocuments(docs, true);
+    ASSERT_EQ(400, results.size());
+    ASSERT_EQ(300, db->DocCount());
+    ASSERT_EQ(300, db->UpdateSequence());
+    
+    // the results are in the order the documents were posted
+    for (auto i = 0; i < 400; ++i) {
+        const auto& result = results[i];
+        if (i % 2 == 0) {
+            ASSERT_STREQ(MakeDocId((i / 2) % 100).c_str(), result.id_.c_str());
+            ASSERT_EQ(i < 200, result.ok_);
+        } else {
+            ASSERT_TRUE(result.ok_);
+            ASSERT_EQ(32, result.id_.size());
+        }
+        
+        if (result.ok_) {
+            auto doc = db->GetDocument(result.id_.c_str());
+            ASSERT_STREQ(result.rev_.c_str(), doc->getRev());
+        } else {
+            ASSERT_STREQ("conflict", result.error_.c_str());
+        }
+    }
+}
+
+TEST_F(BasicDatabaseTests, test64) {
+    auto dbName = "basicdatabasetests64";
+    databases_.AddDatabase(dbName);
+    auto db = databases_.GetDatabase(dbName);
+    
+    auto makeObject = [](const std::string& json) {
+        std::vector<char> buffer{json.cbegin(), json.cend()};
+        buffer.push_back('\0');
+        
+        rs::scriptobject::ScriptObjectJsonSource source(buffer.data());
+        return rs::scriptobject::ScriptObjectFactory::CreateObject(source, false);
+    };
+    
+    const std::string lorem(50 * 1024, 'x');
+    auto id = MakeDocId(0);
+    auto doc = db->SetDocument(id.c_str(), makeObject((boost::format(R"({"_id":"%s","lorem":"%s"})") % id % lorem).str()));
+    
+    // writers racing to update the same revision are hashed concurrently, but only one wins
+    const auto writers = 4;
+    for (auto round = 0; round < 8; ++round) {
+        std::vector<script_object_ptr> objs;
+        for (auto i = 0; i < writers; ++i) {
+            objs.emplace_back(makeObject((boost::format(R"({"_id":"%s","_rev":"%s","writer":%d,"lorem":"%s"})") % id % doc->getRev() % i % lorem).str()));
+        }
+        
+        std::atomic<int> conflicts{0};
+        std::vector<document_ptr> newDocs(writers);
+        std::vector<std::thread> threads;
+        for (auto i = 0; i < writers; ++i) {
+            threads.emplace_back([&, i]() {
+                try {
+                    newDocs[i] = db->SetDocument(id.c_str(), objs[i]);
+                } catch (const DocumentConflict&) {
+                    ++conflicts;
+                }
+            });
+        }
+        
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        
+        ASSERT_EQ(writers - 1, conflicts);
+        
+        auto newDoc = std::find_if(newDocs.cbegin(), newDocs.cend(), [](const document_ptr& doc) { return !!doc; });
+        ASSERT_NE(newDocs.cend(), newDoc);
+        ASSERT_TRUE(ValidateRevision(round + 2, *newDoc));
+        ASSERT_EQ(*newDoc, db->GetDocument(id.c_str()));
+        
+        // an object which isn't shared with a stored document is prepared in place
+        ASSERT_EQ(objs[newDoc - newDocs.cbegin()], (*newDoc)->getObject());
+        
+        doc = *newDoc;
+    }
+    
+    // writers posting back the stored object race the same way, and the stored document is left as it was
+    const std::string rev = doc->getRev();
+    std::atomic<int> conflicts{0};
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < writers; ++i) {
+        threads.emplace_back([&]() {
+            try {
+                db->SetDocument(id.c_str(), doc->getObject());
+            } catch (const DocumentConflict&) {
+                ++conflicts;
+            }
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    ASSERT_EQ(writers - 1, conflicts);
+    ASSERT_STREQ(rev.c_str(), doc->getObject()->getString("_rev"));
+    ASSERT_TRUE(ValidateRevision(10, db->GetDocument(id.c_str())));
+    
+    ASSERT_EQ(1, db->DocCount());
+    ASSERT_EQ(10, db->UpdateSequence());
+}
+
+TEST_F(BasicDatabaseTests, test65) {
+    auto coll = DocumentCollection::Create();
+    auto insert = [&](int i, int seq) {
+        auto obj = docs_->getObject(i);
+        auto doc = Document::Create(obj->getString("_id"), obj, seq);
+        coll->insert(doc);
+        return doc;
+    };
+    
+    for (auto i = 0; i < 100; i += 2) {
+        insert(i, i + 1);
+    }
+    
+    auto snapshot = coll->snapshot();
+    ASSERT_EQ(50, snapshot->size());
+    
+    // the writes since the snapshot are sought by id, only those within the range are returned
+    coll->erase((*snapshot)[5]);
+    coll->erase((*snapshot)[6]);
+    insert(15, 101);
+    coll->erase((*snapshot)[10]);
+    insert(30, 102);
+    insert(51, 103);
+    insert(71, 104);
+    
+    auto version = coll->version(MakeDocId(20).c_str(), true, MakeDocId(60).c_str(), false, false, 1);
+    ASSERT_EQ(snapshot, version.docs_);
+    ASSERT_EQ(50, version.size_);
+    ASSERT_EQ(-1, version.offset_);
+    ASSERT_EQ(1, version.added_->size());
+    ASSERT_STREQ(MakeDocId(30).c_str(), (*version.added_)[0]->getId());
+    ASSERT_EQ(102, (*version.added_)[0]->getUpdateSequence());
+    ASSERT_EQ(1, version.erased_->size());
+    ASSERT_STREQ(MakeDocId(20).c_str(), (*version.erased_)[0]->getId());
+    
+    version = coll->version(MakeDocId(20).c_str(), true, MakeDocId(60).c_str(), false, false, 10);
+    ASSERT_EQ(2, version.added_->size());
+    ASSERT_STREQ(MakeDocId(51).c_str(), (*version.added_)[1]->getId());
+    
+    // descending the writes come in reverse and the offset counts the writes above the range
+    version = coll->version(MakeDocId(20).c_str(), true, MakeDocId(60).c_str(), true, true, 1);
+    ASSERT_EQ(1, version.offset_);
+    ASSERT_EQ(1, version.added_->size());
+    ASSERT_STREQ(MakeDocId(51).c_str(), (*version.added_)[0]->getId());
+    ASSERT_EQ(0, version.erased_->size());
+    
+    version = coll->version(nullptr, true, nullptr, true, false, 100);
+    ASSERT_EQ(0, version.offset_);
+    ASSERT_EQ(4, version.added_->size());
+    ASSERT_EQ(3, version.erased_->size());
+    ASSERT_STREQ(MakeDocId(12).c_str(), (*version.erased_)[1]->getId());
+}
@@ -21,6 +21,10 @@
 #include <vector>
 #include <cstring>
 #include <memory>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <algorithm>
 
 #include <boost/format.hpp>
 
@@ -39,6 +43,11 @@
 #include "../map_reduce_thread_pool.h"
 #include "../map_reduce_result.h"
 #include "../map_reduce_result_comparers.h"
+#include "../map_reduce_results_iterator.h"
+#include "../map_reduce.h"
+#include "../map_reduce_cancellation.h"
+#include "../map_reduce_result_array.h"
+#include "../document_collection.h"
 
 class MapReduceTests : public ::testing::Test {
 protected:
@@ -116,6 +125,40 @@ protected:
         return obj;
     }
     
+    static rs::scriptobject::ScriptObjectPtr MakeObject(const std::string& json) {
+        std::vector<char> buffer{json.cbegin(), json.cend()};
+        buffer.push_back('\0');
+        
+        rs::scriptobject::ScriptObjectJsonSource source(buffer.data());        
+        return rs::scriptobject::ScriptObjectFactory::CreateObject(source, false);
+    }
+    
+    static rs::scriptobject::ScriptObjectPtr MakeDesignObject(const char* viewName, const char* mapFunc, const char* reduceFunc = nullptr) {
+        std::string reduce;
+        if (reduceFunc) {
+            reduce = (boost::format(R"(,"reduce":"%s")") % reduceFunc).str();
+        }
+        
+        auto json = (boost::format(R"({"views":{"%s":{"map":"%s"%s}}})") % viewName % mapFunc % reduce).str();
+        return MakeObject(json);
+    }
+    
+    static database_ptr MakeDatabase(const char* dbName) {
+        databases_.AddDatabase(dbName);
+        auto db = databases_.GetDatabase(dbName);
+        
+        db->PostBulkDocuments(docs_, true);
+        
+        return db;
+    }
+    
+    static database_ptr MakeViewDatabase(const char* dbName, const char* viewName, const char* mapFunc, const char* reduceFunc = nullptr) {
+        auto db = MakeDatabase(dbName);
+        db->SetDesignDocument("test", MakeDesignObject(viewName, mapFunc, reduceFunc));
+        
+        return db;
+    }
+    
     static Databases databases_;
     static database_ptr db_;
     static script_array_ptr docs_;
@@ -1010,4 +1053,1017 @@ TEST_F(MapReduceTests, test37) {
     auto iter = results->cbegin();
     auto end = results->cend();       
     ASSERT_EQ(0, std::distance(iter, end));
-}
\ No newline at end of file
+}
+
+TEST_F(MapReduceTests, test38) {
+    auto db = MakeViewDatabase("mapreduceviewtests38", "index", R"(function(doc) { emit(doc.index, null); })");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto results = db->GetDesignDocumentView(options, "test", "index");
+    
+    ASSERT_NE(nullptr, results);
+    ASSERT_EQ(0, results->Offset());
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    
+    auto iter = results->cbegin();
+    auto end = results->cend();       
+    ASSERT_EQ(docs_->getCount(), std::distance(iter, end));
+    
+    for (unsigned i = 0; iter != end; ++iter, ++i) {
+        ASSERT_EQ(i, (*iter)->getKeyDouble());
+        ASSERT_STREQ(MakeDocId(i).c_str(), (*iter)->getId());
+    }
+    
+    auto cachedResults = db->GetDesignDocumentView(options, "test", "index");
+    ASSERT_EQ(docs_->getCount(), cachedResults->TotalRows());
+    ASSERT_EQ(docs_->getCount(), std::distance(cachedResults->cbegin(), cachedResults->cend()));
+}
+
+TEST_F(MapReduceTests, test39) {
+    auto db = MakeViewDatabase("mapreduceviewtests39", "index", R"(function(doc) { emit(doc.index, null); })");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto results = db->GetDesignDocumentView(options, "test", "index");
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    
+    auto id = MakeDocId(0);
+    auto doc = db->GetDocument(id.c_str());
+    db->SetDocument(id.c_str(), MakeObject((boost::format(R"({"_id":"%s","_rev":"%s","index":2000})") % id % doc->getRev()).str()));
+    
+    id = MakeDocId(1);
+    doc = db->GetDocument(id.c_str());
+    db->DeleteDocument(id.c_str(), doc->getRev());
+    
+    auto updatedResults = db->GetDesignDocumentView(options, "test", "index");
+    
+    ASSERT_NE(nullptr, updatedResults);
+    ASSERT_EQ(docs_->getCount() - 1, updatedResults->TotalRows());
+    
+    auto iter = updatedResults->cbegin();
+    auto end = updatedResults->cend();       
+    ASSERT_EQ(docs_->getCount() - 1, std::distance(iter, end));
+    ASSERT_EQ(2, (*iter)->getKeyDouble());
+    ASSERT_EQ(2000, (*(end - 1))->getKeyDouble());
+    ASSERT_STREQ(MakeDocId(0).c_str(), (*(end - 1))->getId());
+    
+    // the earlier results are unaffected by the refresh
+    ASSERT_EQ(docs_->getCount(), std::distance(results->cbegin(), results->cend()));
+    ASSERT_EQ(0, (*results->cbegin())->getKeyDouble());
+}
+
+TEST_F(MapReduceTests, test40) {
+    auto db = MakeViewDatabase("mapreduceviewtests40", "index", R"(function(doc) { emit(doc.index, null); })");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    ASSERT_THROW({
+        db->GetDesignDocumentView(options, "test", "missing");
+    }, ViewMissing);
+    
+    ASSERT_THROW({
+        db->GetDesignDocumentView(options, "missing", "index");
+    }, DocumentMissing);
+}
+
+TEST_F(MapReduceTests, test41) {
+    auto db = MakeViewDatabase("mapreduceviewtests41", "index", R"(function(doc) { emit(doc.index, null); })");
+    
+    rs::httpserver::QueryString qs{"limit=10"};
+    GetViewOptions options{qs};
+    
+    auto results = db->GetDesignDocumentView(options, "test", "index");
+    ASSERT_EQ(rs::scriptobject::ScriptObjectType::Int32, (*results->cbegin())->getKeyType());
+    
+    auto designDoc = db->GetDesignDocument("test");
+    auto designObj = MakeObject((boost::format(R"({"_rev":"%s","views":{"index":{"map":"function(doc) { emit(doc.lorem, doc.index); }"}}})") % designDoc->getRev()).str());
+    db->SetDesignDocument("test", designObj);
+    
+    results = db->GetDesignDocumentView(options, "test", "index");
+    
+    ASSERT_NE(nullptr, results);
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    ASSERT_EQ(10, std::distance(results->cbegin(), results->cend()));
+    ASSERT_EQ(rs::scriptobject::ScriptObjectType::String, (*results->cbegin())->getKeyType());
+    ASSERT_STREQ("ipsum", (*results->cbegin())->getKeyString());
+}
+
+TEST_F(MapReduceTests, test42) {
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto threadPool = MapReduceThreadPool::Get();
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(doc.index, 42); })");
+    
+    auto misses = threadPool->GetFunctionCacheMisses();
+    auto results = db_->PostTempView(options, mapObj);
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    ASSERT_LT(misses, threadPool->GetFunctionCacheMisses());
+    
+    misses = threadPool->GetFunctionCacheMisses();
+    auto hits = threadPool->GetFunctionCacheHits();
+    
+    auto dbName = "mapreducetests42";
+    databases_.AddDatabase(dbName);
+    auto db = databases_.GetDatabase(dbName);
+    db->PostBulkDocuments(docs_, true);
+    
+    results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    ASSERT_EQ(misses, threadPool->GetFunctionCacheMisses());
+    ASSERT_LT(hits, threadPool->GetFunctionCacheHits());
+    
+    auto iter = results->cbegin();
+    ASSERT_EQ(0, (*iter)->getKeyDouble());
+    ASSERT_EQ(42, (*iter)->getValueDouble());
+}
+
+TEST_F(MapReduceTests, test43) {
+    auto dbName = "mapreducetests43";
+    databases_.AddDatabase(dbName);
+    auto db = databases_.GetDatabase(dbName);
+    db->PostBulkDocuments(docs_, true);
+    
+    auto threadPool = MapReduceThreadPool::Get();
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(doc.index, 43); })");
+    
+    rs::httpserver::QueryString qs{"limit=10"};
+    GetViewOptions options{qs};
+    
+    auto results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(0, results->Offset());
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    ASSERT_EQ(10, std::distance(results->cbegin(), results->cend()));
+    
+    // cached slices don't run the map again
+    auto hits = threadPool->GetFunctionCacheHits();
+    auto misses = threadPool->GetFunctionCacheMisses();
+    
+    rs::httpserver::QueryString qs2{"startkey=500&limit=5"};
+    GetViewOptions options2{qs2};
+    
+    results = db->PostTempView(options2, mapObj);
+    ASSERT_EQ(500, results->Offset());
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    ASSERT_EQ(5, std::distance(results->cbegin(), results->cend()));
+    ASSERT_EQ(500, (*results->cbegin())->getKeyDouble());
+    
+    rs::httpserver::QueryString qs3{"descending=true&skip=1&limit=3"};
+    GetViewOptions options3{qs3};
+    
+    results = db->PostTempView(options3, mapObj);
+    ASSERT_EQ(1, results->Offset());
+    ASSERT_EQ(3, std::distance(results->cbegin(), results->cend()));
+    
+    auto iter = results->Iterator();
+    ASSERT_EQ(998, iter.Next()->getKeyDouble());
+    
+    ASSERT_EQ(hits, threadPool->GetFunctionCacheHits());
+    ASSERT_EQ(misses, threadPool->GetFunctionCacheMisses());
+    
+    // an update invalidates the cached rows
+    auto id = MakeDocId(0);
+    auto doc = db->GetDocument(id.c_str());
+    db->SetDocument(id.c_str(), MakeObject((boost::format(R"({"_id":"%s","_rev":"%s","index":2000})") % id % doc->getRev()).str()));
+    
+    results = db->PostTempView(options3, mapObj);
+    ASSERT_EQ(1, results->Offset());
+    
+    auto updatedIter = results->Iterator();
+    ASSERT_EQ(999, updatedIter.Next()->getKeyDouble());
+    ASSERT_LT(hits, threadPool->GetFunctionCacheHits());
+}
+
+TEST_F(MapReduceTests, test44) {
+    auto db = MakeViewDatabase("mapreduceviewtests44", "count", R"(function(doc) { emit(doc.index, doc.num); })", "_count");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto results = db->GetDesignDocumentView(options, "test", "count");
+    auto reducedResults = results->ReducedResults();
+    ASSERT_NE(nullptr, reducedResults);
+    ASSERT_EQ(1, reducedResults->size());
+    
+    auto row = reducedResults->at(0);
+    ASSERT_EQ(rs::scriptobject::ScriptObjectType::Null, row->getType(MapReduceResult::KeyIndex));
+    ASSERT_EQ(docs_->getCount(), row->getDouble(MapReduceResult::ValueIndex));
+    
+    rs::httpserver::QueryString qs2{"startkey=100&endkey=199"};
+    GetViewOptions options2{qs2};
+    
+    results = db->GetDesignDocumentView(options2, "test", "count");
+    ASSERT_EQ(100, results->ReducedResults()->at(0)->getDouble(MapReduceResult::ValueIndex));
+    
+    rs::httpserver::QueryString qs3{"reduce=false&limit=10"};
+    GetViewOptions options3{qs3};
+    
+    results = db->GetDesignDocumentView(options3, "test", "count");
+    ASSERT_EQ(nullptr, results->ReducedResults());
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    ASSERT_EQ(10, std::distance(results->cbegin(), results->cend()));
+}
+
+TEST_F(MapReduceTests, test45) {
+    auto db = MakeDatabase("mapreducetests45");
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(doc.index % 10, doc.index); })", "_sum");
+    
+    rs::httpserver::QueryString qs{"group=true"};
+    GetViewOptions options{qs};
+    
+    auto results = db->PostTempView(options, mapObj);
+    auto reducedResults = results->ReducedResults();
+    ASSERT_NE(nullptr, reducedResults);
+    ASSERT_EQ(10, reducedResults->size());
+    
+    for (auto i = 0; i < 10; ++i) {
+        auto row = reducedResults->at(i);
+        ASSERT_EQ(i, row->getDouble(MapReduceResult::KeyIndex));
+        ASSERT_EQ((100 * i) + 49500, row->getDouble(MapReduceResult::ValueIndex));
+    }
+    
+    rs::httpserver::QueryString qs2{"group=true&descending=true&skip=1&limit=2"};
+    GetViewOptions options2{qs2};
+    
+    results = db->PostTempView(options2, mapObj);
+    reducedResults = results->ReducedResults();
+    ASSERT_EQ(2, reducedResults->size());
+    ASSERT_EQ(8, reducedResults->at(0)->getDouble(MapReduceResult::KeyIndex));
+    ASSERT_EQ(7, reducedResults->at(1)->getDouble(MapReduceResult::KeyIndex));
+}
+
+TEST_F(MapReduceTests, test46) {
+    auto db = MakeDatabase("mapreducetests46");
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(null, doc.index); })", "_stats");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto results = db->PostTempView(options, mapObj);
+    auto reducedResults = results->ReducedResults();
+    ASSERT_EQ(1, reducedResults->size());
+    
+    auto stats = reducedResults->at(0)->getObject(MapReduceResult::ValueIndex);
+    ASSERT_EQ(499500, stats->getDouble("sum"));
+    ASSERT_EQ(1000, stats->getDouble("count"));
+    ASSERT_EQ(0, stats->getDouble("min"));
+    ASSERT_EQ(999, stats->getDouble("max"));
+    ASSERT_EQ(332833500, stats->getDouble("sumsqr"));
+}
+
+TEST_F(MapReduceTests, test47) {
+    auto db = MakeDatabase("mapreducetests47");
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { emit([doc.index % 2, doc.index % 5, doc.index], [1, doc.index]); })", "_sum");
+    
+    rs::httpserver::QueryString qs{"group_level=1"};
+    GetViewOptions options{qs};
+    
+    auto results = db->PostTempView(options, mapObj);
+    auto reducedResults = results->ReducedResults();
+    ASSERT_EQ(2, reducedResults->size());
+    
+    for (auto i = 0; i < 2; ++i) {
+        auto row = reducedResults->at(i);
+        auto key = row->getArray(MapReduceResult::KeyIndex);
+        ASSERT_EQ(1, key->getCount());
+        ASSERT_EQ(i, key->getDouble(0));
+        
+        auto value = row->getArray(MapReduceResult::ValueIndex);
+        ASSERT_EQ(500, value->getDouble(0));
+        ASSERT_EQ(249500 + (500 * i), value->getDouble(1));
+    }
+    
+    rs::httpserver::QueryString qs2{"group_level=2&startkey=[1]"};
+    GetViewOptions options2{qs2};
+    
+    results = db->PostTempView(options2, mapObj);
+    reducedResults = results->ReducedResults();
+    ASSERT_EQ(5, reducedResults->size());
+    
+    auto key = reducedResults->at(0)->getArray(MapReduceResult::KeyIndex);
+    ASSERT_EQ(2, key->getCount());
+    ASSERT_EQ(1, key->getDouble(0));
+    ASSERT_EQ(0, key->getDouble(1));
+    ASSERT_EQ(100, reducedResults->at(0)->getArray(MapReduceResult::ValueIndex)->getDouble(0));
+}
+
+TEST_F(MapReduceTests, test48) {
+    auto db = MakeDatabase("mapreducetests48");
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { emit([doc.index % 100, 'key'], null); })", "_approx_count_distinct");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto results = db->PostTempView(options, mapObj);
+    auto reducedResults = results->ReducedResults();
+    ASSERT_EQ(1, reducedResults->size());
+    ASSERT_NEAR(100, reducedResults->at(0)->getDouble(MapReduceResult::ValueIndex), 5);
+}
+
+TEST_F(MapReduceTests, test49) {
+    auto db = MakeDatabase("mapreducetests49");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(doc.index, null); })", "_median");
+    ASSERT_THROW(db->PostTempView(options, mapObj), BuiltInReduceError);
+    
+    mapObj = MakeMapObject(R"(function(doc) { emit(doc.index, doc.lorem); })", "_sum");
+    ASSERT_THROW(db->PostTempView(options, mapObj), BuiltInReduceError);
+    
+    mapObj = MakeMapObject(R"(function(doc) { emit(doc.index, doc.obj); })", "_stats");
+    ASSERT_THROW(db->PostTempView(options, mapObj), BuiltInReduceError);
+}
+
+TEST_F(MapReduceTests, test50) {
+    auto db = MakeDatabase("mapreducetests50");
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(doc.index % 10, doc.index); })", R"(function(keys, values, rereduce) { return sum(values); })");
+    
+    rs::httpserver::QueryString qs{"group=true"};
+    GetViewOptions options{qs};
+    
+    auto results = db->PostTempView(options, mapObj);
+    auto reducedResults = results->ReducedResults();
+    ASSERT_NE(nullptr, reducedResults);
+    ASSERT_EQ(10, reducedResults->size());
+    
+    for (auto i = 0; i < 10; ++i) {
+        auto row = reducedResults->at(i);
+        ASSERT_EQ(i, row->getDouble(MapReduceResult::KeyIndex));
+        ASSERT_EQ((100 * i) + 49500, row->getDouble(MapReduceResult::ValueIndex));
+    }
+    
+    rs::httpserver::QueryString qs2{""};
+    GetViewOptions options2{qs2};
+    
+    results = db->PostTempView(options2, mapObj);
+    reducedResults = results->ReducedResults();
+    ASSERT_EQ(1, reducedResults->size());
+    ASSERT_EQ(rs::scriptobject::ScriptObjectType::Null, reducedResults->at(0)->getType(MapReduceResult::KeyIndex));
+    ASSERT_EQ(499500, reducedResults->at(0)->getDouble(MapReduceResult::ValueIndex));
+}
+
+TEST_F(MapReduceTests, test51) {
+    auto db = MakeViewDatabase("mapreduceviewtests51", "count", 
+        R"(function(doc) { emit([doc.index % 2, doc.index], null); })",
+        R"(function(keys, values, rereduce) { return rereduce ? sum(values) : values.length; })");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto results = db->GetDesignDocumentView(options, "test", "count");
+    auto reducedResults = results->ReducedResults();
+    ASSERT_EQ(1, reducedResults->size());
+    ASSERT_EQ(docs_->getCount(), reducedResults->at(0)->getDouble(MapReduceResult::ValueIndex));
+    
+    rs::httpserver::QueryString qs2{"group_level=1&descending=true"};
+    GetViewOptions options2{qs2};
+    
+    results = db->GetDesignDocumentView(options2, "test", "count");
+    reducedResults = results->ReducedResults();
+    ASSERT_EQ(2, reducedResults->size());
+    ASSERT_EQ(1, reducedResults->at(0)->getArray(MapReduceResult::KeyIndex)->getDouble(0));
+    ASSERT_EQ(500, reducedResults->at(0)->getDouble(MapReduceResult::ValueIndex));
+    ASSERT_EQ(0, reducedResults->at(1)->getArray(MapReduceResult::KeyIndex)->getDouble(0));
+    ASSERT_EQ(500, reducedResults->at(1)->getDouble(MapReduceResult::ValueIndex));
+}
+
+TEST_F(MapReduceTests, test52) {
+    auto db = MakeDatabase("mapreducetests52");
+    
+    rs::httpserver::QueryString qs{"group=true&startkey=5&limit=1"};
+    GetViewOptions options{qs};
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(doc.index, null); })", R"(function(keys, values, rereduce) { return keys[0][1]; })");
+    auto results = db->PostTempView(options, mapObj);
+    auto reducedResults = results->ReducedResults();
+    ASSERT_EQ(1, reducedResults->size());
+    ASSERT_EQ(5, reducedResults->at(0)->getDouble(MapReduceResult::KeyIndex));
+    ASSERT_STREQ(MakeDocId(5).c_str(), reducedResults->at(0)->getString(MapReduceResult::ValueIndex));
+    
+    mapObj = MakeMapObject(R"(function(doc) { emit(doc.index, null); })", R"(function(keys, values, rereduce) { throw 'reduce'; })");
+    ASSERT_THROW(db->PostTempView(options, mapObj), CompilationError);
+}
+
+TEST_F(MapReduceTests, test53) {
+    auto db = MakeDatabase("mapreducetests53");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto mapObj = MakeMapObject(R"({\"filter\":[{\"field\":\"index\",\"op\":\"lt\",\"value\":10}],\"key\":[\"lorem\",\"index\"],\"value\":\"num\"})", nullptr, "native");
+    auto results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(10, results->TotalRows());
+    
+    auto iter = results->cbegin();
+    for (auto i = 0; iter != results->cend(); ++iter, ++i) {
+        auto key = (*iter)->getKeyArray();
+        ASSERT_STREQ("ipsum", key->getString(0));
+        ASSERT_EQ(i, key->getDouble(1));
+        ASSERT_EQ(42, (*iter)->getValueDouble());
+        ASSERT_STREQ(MakeDocId(i).c_str(), (*iter)->getId());
+    }
+    
+    mapObj = MakeMapObject(R"({\"filter\":{\"sunny\":true,\"obj.missing\":1},\"key\":\"index\"})", nullptr, "native");
+    results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(0, results->TotalRows());
+    
+    mapObj = MakeMapObject(R"({\"filter\":{\"sunny\":true},\"key\":\"index\",\"value\":\"pi\"})", "_sum", "native");
+    results = db->PostTempView(options, mapObj);
+    ASSERT_NEAR(3141.59, results->ReducedResults()->at(0)->getDouble(MapReduceResult::ValueIndex), 0.001);
+    
+    mapObj = MakeMapObject(R"({\"filter\":[{\"field\":\"index\",\"op\":\"like\",\"value\":1}]})", nullptr, "native");
+    ASSERT_THROW(db->PostTempView(options, mapObj), CompilationError);
+    
+    mapObj = MakeMapObject(R"(function(doc) { emit(doc.index, null); })", nullptr, "native");
+    ASSERT_THROW(db->PostTempView(options, mapObj), CompilationError);
+}
+
+TEST_F(MapReduceTests, test54) {
+    auto db = MakeViewDatabase("mapreduceviewtests54", "index", R"(function(doc) { emit(doc.index, null); })");
+    
+    rs::httpserver::QueryString qs{"startkey=100&skip=5&limit=50"};
+    GetViewOptions options{qs};
+    
+    auto results = db->GetDesignDocumentView(options, "test", "index");
+    ASSERT_EQ(105, results->Offset());
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    ASSERT_EQ(50, std::distance(results->cbegin(), results->cend()));
+    
+    auto iter = results->Iterator();
+    for (auto i = 105; i < 155; ++i) {
+        ASSERT_EQ(i, iter.Next()->getKeyDouble());
+    }
+    ASSERT_EQ(nullptr, iter.Next());
+    
+    rs::httpserver::QueryString qs2{"startkey=900&descending=true&skip=2&limit=10"};
+    GetViewOptions options2{qs2};
+    
+    results = db->GetDesignDocumentView(options2, "test", "index");
+    ASSERT_EQ(10, std::distance(results->cbegin(), results->cend()));
+    
+    auto descendingIter = results->Iterator();
+    for (auto i = 898; i > 888; --i) {
+        ASSERT_EQ(i, descendingIter.Next()->getKeyDouble());
+    }
+    ASSERT_EQ(nullptr, descendingIter.Next());
+}
+
+TEST_F(MapReduceTests, test55) {
+    auto db = MakeDatabase("mapreducetests55");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    // enough rows for the shards to be merged on the thread pool
+    auto mapObj = MakeMapObject(R"(function(doc) { for (var i = 0; i < 16; ++i) { emit((i * 7919 + doc.index) % 1000, i); } })");
+    auto results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(docs_->getCount() * 16, results->TotalRows());
+    ASSERT_EQ(docs_->getCount() * 16, std::distance(results->cbegin(), results->cend()));
+    
+    auto iter = results->cbegin();
+    auto lastKey = (*iter)->getKeyDouble();
+    for (++iter; iter != results->cend(); ++iter) {
+        auto key = (*iter)->getKeyDouble();
+        ASSERT_LE(lastKey, key);
+        lastKey = key;
+    }
+}
+
+TEST_F(MapReduceTests, test56) {
+    auto db = MakeDatabase("mapreducetests56");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    // the keys are emitted out of order with their expected position as the value
+    auto mapObj = MakeMapObject(R"(function(doc) { if (doc.index == 0) { var keys = [[2], {\"a\":1,\"b\":2}, \"ab\", -1.5, true, [1,2], null, \"b\", 0, {\"b\":0}, false, [1], 2, \"a\", {\"a\":1}]; var order = [11, 13, 7, 3, 2, 10, 0, 8, 4, 14, 1, 9, 5, 6, 12]; for (var i = 0; i < keys.length; ++i) { emit(keys[i], order[i]); } emit(-0, 4); } })");
+    auto results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(16, results->TotalRows());
+    
+    auto iter = results->cbegin();
+    for (auto i = 0; iter != results->cend(); ++iter, ++i) {
+        ASSERT_EQ(i < 5 ? i : i - 1, (*iter)->getValueDouble());
+    }
+    
+    rs::httpserver::QueryString qs2{"startkey=\"ab\"&endkey=[1,2]"};
+    GetViewOptions options2{qs2};
+    
+    results = db->PostTempView(options2, mapObj);
+    ASSERT_EQ(4, std::distance(results->cbegin(), results->cend()));
+    ASSERT_EQ(7, (*results->cbegin())->getValueDouble());
+}
+
+TEST_F(MapReduceTests, test57) {
+    auto db = MakeViewDatabase("mapreduceviewtests57", "index", R"(function(doc) { emit(doc.index, null); })");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto results = db->GetDesignDocumentView(options, "test", "index");
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    
+    // once most of the mapped rows are stale the shards are mapped again
+    for (decltype(docs_->getCount()) i = 1; i < docs_->getCount(); ++i) {
+        auto id = MakeDocId(i);
+        auto doc = db->GetDocument(id.c_str());
+        db->DeleteDocument(id.c_str(), doc->getRev());
+    }
+    
+    auto updatedResults = db->GetDesignDocumentView(options, "test", "index");
+    ASSERT_EQ(1, updatedResults->TotalRows());
+    ASSERT_EQ(0, (*updatedResults->cbegin())->getKeyDouble());
+    ASSERT_STREQ(MakeDocId(0).c_str(), (*updatedResults->cbegin())->getDoc()->getId());
+    
+    auto id = MakeDocId(0);
+    for (auto i = 1; i <= 5; ++i) {
+        auto doc = db->GetDocument(id.c_str());
+        db->SetDocument(id.c_str(), MakeObject((boost::format(R"({"_id":"%s","_rev":"%s","index":%d})") % id % doc->getRev() % i).str()));
+        
+        updatedResults = db->GetDesignDocumentView(options, "test", "index");
+        ASSERT_EQ(1, updatedResults->TotalRows());
+        ASSERT_EQ(i, (*updatedResults->cbegin())->getKeyDouble());
+    }
+    
+    // the earlier results still hold their rows
+    ASSERT_EQ(docs_->getCount(), std::distance(results->cbegin(), results->cend()));
+    ASSERT_EQ(0, (*results->cbegin())->getKeyDouble());
+}
+
+TEST_F(MapReduceTests, test58) {
+    document_collections_ptr_array colls;
+    for (auto i = 0; i < 4; ++i) {
+        colls.emplace_back(DocumentCollection::Create());
+    }
+    
+    for (auto i = 0; i < docs_->getCount(); ++i) {
+        auto obj = docs_->getObject(i);
+        colls[i % colls.size()]->insert(Document::Create(obj->getString("_id"), obj, i + 1));
+    }
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { if (doc.sunny) { emit(doc.index, doc.num); } })");
+    auto task = MapReduce::MapReduceTask::Create(mapObj);
+    
+    MapReduce mapReduce{1};
+    auto results = mapReduce.Execute(task, colls);
+    ASSERT_GT(results->size(), 0);
+    
+    // batches which don't divide the shards end with a partial batch
+    for (auto batchSize : { 3u, 256u }) {
+        MapReduce batchedMapReduce{batchSize};
+        auto batchedResults = batchedMapReduce.Execute(task, colls);
+        
+        ASSERT_EQ(results->size(), batchedResults->size());
+        for (decltype(results->size()) i = 0; i < results->size(); ++i) {
+            ASSERT_STREQ((*results)[i]->getId(), (*batchedResults)[i]->getId());
+            ASSERT_EQ((*results)[i]->getKeyDouble(), (*batchedResults)[i]->getKeyDouble());
+            ASSERT_EQ((*results)[i]->getValueDouble(), (*batchedResults)[i]->getValueDouble());
+        }
+    }
+}
+
+TEST_F(MapReduceTests, DISABLED_benchmark58) {
+    document_collections_ptr_array colls;
+    for (auto i = 0; i < 4; ++i) {
+        colls.emplace_back(DocumentCollection::Create());
+    }
+    
+    const auto docCount = 100000;
+    for (auto i = 0; i < docCount; ++i) {
+        auto id = MakeDocId(i);
+        colls[i % colls.size()]->insert(Document::Create(id.c_str(), docs_->getObject(i % docs_->getCount()), i + 1));
+    }
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { if (doc.sunny) { emit(doc.index, doc.num); } })");
+    auto task = MapReduce::MapReduceTask::Create(mapObj);
+    
+    // compare the throughput of calling the map for each document with batched calls
+    auto benchmark = [&](unsigned batchSize) {
+        MapReduce mapReduce{batchSize};
+        mapReduce.Execute(task, colls);
+        
+        auto start = std::chrono::steady_clock::now();
+        auto results = mapReduce.Execute(task, colls);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        
+        std::cout << "map batch size " << batchSize << ": " << static_cast<std::uint64_t>(docCount / elapsed.count()) << " docs/sec" << std::endl;
+        return results;
+    };
+    
+    auto results = benchmark(1);
+    auto batchedResults = benchmark(Config::MapReduce::GetMapBatchSize());
+    
+    ASSERT_EQ(results->size(), batchedResults->size());
+}
+
+TEST_F(MapReduceTests, test59) {
+    auto db = MakeDatabase("mapreducetests59");
+    db->SetDocument("shape", MakeObject(R"({"_id":"shape","a":1,"b":{"c":2,"d":[3]},"index":-1})"));
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    // documents of different shapes are enumerated and read in the same map
+    auto mapObj = MakeMapObject(R"(function(doc) { var n = 0; for (var k in doc) { ++n; } emit(doc.index, [n, Object.keys(doc).length, doc.b ? Object.keys(doc.b).join() : doc.lorem, doc.missing === undefined]); })");
+    auto results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(docs_->getCount() + 1, results->TotalRows());
+    
+    auto iter = results->cbegin();
+    auto value = (*iter)->getValueArray();
+    ASSERT_STREQ("shape", (*iter)->getId());
+    ASSERT_EQ(value->getDouble(0), value->getDouble(1));
+    ASSERT_STREQ("c,d", value->getString(2));
+    ASSERT_TRUE(value->getBoolean(3));
+    
+    auto firstCount = 0.0;
+    for (++iter; iter != results->cend(); ++iter) {
+        value = (*iter)->getValueArray();
+        firstCount = firstCount == 0 ? value->getDouble(0) : firstCount;
+        ASSERT_EQ(firstCount, value->getDouble(0));
+        ASSERT_EQ(value->getDouble(0), value->getDouble(1));
+        ASSERT_STREQ("ipsum", value->getString(2));
+        ASSERT_TRUE(value->getBoolean(3));
+    }
+}
+
+TEST_F(MapReduceTests, test60) {
+    auto db = MakeDatabase("mapreducetests60");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    // scalar rows are held inline while object and array rows are held in a script array
+    auto mapObj = MakeMapObject(R"(function(doc) { if (doc.index % 2) { emit(doc.lorem, doc.index % 3 == 0); } else { emit([doc.lorem], {pi: doc.pi}); } })");
+    auto results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    
+    auto trueCount = 0;
+    auto iter = results->cbegin();
+    for (auto i = 0; i < 500; ++i, ++iter) {
+        ASSERT_EQ(rs::scriptobject::ScriptObjectType::String, (*iter)->getKeyType());
+        ASSERT_STREQ("ipsum", (*iter)->getKeyString());
+        ASSERT_EQ(rs::scriptobject::ScriptObjectType::Boolean, (*iter)->getValueType());
+        trueCount += (*iter)->getValueBoolean() ? 1 : 0;
+    }
+    
+    ASSERT_EQ(167, trueCount);
+    
+    for (; iter != results->cend(); ++iter) {
+        ASSERT_STREQ("ipsum", (*iter)->getKeyArray()->getString(0));
+        ASSERT_EQ(3.14159, (*iter)->getValueObject()->getDouble("pi"));
+    }
+    
+    // reduce reads the keys and values of inline rows
+    mapObj = MakeMapObject(R"(function(doc) { emit(doc.index % 2 ? 'odd' : 'even', doc.index); })", R"(function(keys, values, rereduce) { return rereduce || keys[0][0] == 'odd' || keys[0][0] == 'even' ? sum(values) : -1; })");
+    
+    rs::httpserver::QueryString qs2{"group=true"};
+    GetViewOptions options2{qs2};
+    
+    results = db->PostTempView(options2, mapObj);
+    auto reducedResults = results->ReducedResults();
+    ASSERT_EQ(2, reducedResults->size());
+    ASSERT_STREQ("even", reducedResults->at(0)->getString(MapReduceResult::KeyIndex));
+    ASSERT_EQ(249500, reducedResults->at(0)->getDouble(MapReduceResult::ValueIndex));
+    ASSERT_STREQ("odd", reducedResults->at(1)->getString(MapReduceResult::KeyIndex));
+    ASSERT_EQ(250000, reducedResults->at(1)->getDouble(MapReduceResult::ValueIndex));
+}
+
+TEST_F(MapReduceTests, test61) {
+    document_collections_ptr_array colls;
+    for (auto i = 0; i < 4; ++i) {
+        colls.emplace_back(DocumentCollection::Create());
+    }
+    
+    // most of the documents are in one shard
+    const auto docCount = 10000;
+    for (auto i = 0; i < docCount; ++i) {
+        auto id = MakeDocId(i);
+        colls[i % 10 == 0 ? i % colls.size() : 0]->insert(Document::Create(id.c_str(), docs_->getObject(i % docs_->getCount()), i + 1));
+    }
+    
+    // small ranges are merged into the same rows as a single range per shard
+    auto compare = [&](const char* map, const char* language) {
+        auto task = MapReduce::MapReduceTask::Create(MakeMapObject(map, nullptr, language));
+        ASSERT_EQ(language != nullptr, task.NativeMap() != nullptr);
+        
+        auto results = MapReduce{1, docCount}.Execute(task, colls);
+        auto rangeResults = MapReduce{Config::MapReduce::GetMapBatchSize(), 7}.Execute(task, colls);
+        
+        ASSERT_EQ(docCount, results->size());
+        ASSERT_EQ(results->size(), rangeResults->size());
+        for (decltype(results->size()) i = 0; i < results->size(); ++i) {
+            ASSERT_STREQ((*results)[i]->getId(), (*rangeResults)[i]->getId());
+            ASSERT_EQ((*results)[i]->getKeyDouble(), (*rangeResults)[i]->getKeyDouble());
+        }
+    };
+    
+    compare(R"(function(doc) { emit(doc.index, doc.num); })", nullptr);
+    compare(R"({\"key\":\"index\",\"value\":\"num\"})", "native");
+}
+
+TEST_F(MapReduceTests, test62) {
+    document_collections_ptr_array colls;
+    for (auto i = 0; i < 4; ++i) {
+        colls.emplace_back(DocumentCollection::Create());
+    }
+    
+    for (auto i = 0; i < docs_->getCount(); ++i) {
+        auto obj = docs_->getObject(i);
+        colls[i % colls.size()]->insert(Document::Create(obj->getString("_id"), obj, i + 1));
+    }
+    
+    auto task = MapReduce::MapReduceTask::Create(MakeMapObject(R"(function(doc) { emit(doc.index % 100, doc.index); })"));
+    
+    MapReduce mapReduce;
+    auto shardResults = mapReduce.Map(task, colls);
+    auto merged = mapReduce.Execute(task, colls);
+    
+    struct Query final {
+        const char* query_;
+        double startKey_;
+        double endKey_;
+        std::size_t skip_;
+        std::size_t limit_;
+        bool descending_;
+    };
+    
+    const auto all = std::numeric_limits<std::size_t>::max();
+    const Query queries[] = {
+        { "", 0, 99, 0, all, false },
+        { "skip=5&limit=20", 0, 99, 5, 20, false },
+        { "descending=true&skip=3&limit=7", 0, 99, 3, 7, true },
+        { "startkey=10&endkey=20&skip=50", 10, 20, 50, all, false },
+        { "startkey=10&endkey=20&skip=500", 10, 20, 500, all, false },
+        { "skip=2000&limit=5", 0, 99, 2000, 5, false },
+        { "descending=true", 0, 99, 0, all, true }
+    };
+    
+    // rows read while the shards are merged match the rows of the merged array, and the
+    // offset is the same before and after the rows are read
+    for (const auto& query : queries) {
+        rs::httpserver::QueryString qs{query.query_};
+        GetViewOptions options{qs};
+        
+        std::vector<map_reduce_result_ptr> expected;
+        auto first = merged->size();
+        for (decltype(merged->size()) i = 0; i < merged->size(); ++i) {
+            auto key = (*merged)[i]->getKeyDouble();
+            if (key >= query.startKey_ && key <= query.endKey_) {
+                first = std::min(first, i);
+                expected.push_back((*merged)[i]);
+            }
+        }
+        
+        if (query.descending_) {
+            std::reverse(expected.begin(), expected.end());
+            first = 0;
+        }
+        
+        auto skip = std::min(query.skip_, expected.size());
+        auto rows = std::min(query.limit_, expected.size() - skip);
+        
+        auto results = mapReduce.Execute(options, task, shardResults);
+        ASSERT_EQ(first + skip, results->Offset());
+        ASSERT_EQ(merged->size(), results->TotalRows());
+        
+        auto iter = results->Iterator();
+        for (decltype(rows) i = 0; i < rows; ++i) {
+            auto result = iter.Next();
+            ASSERT_NE(nullptr, result);
+            ASSERT_STREQ(expected[skip + i]->getId(), result->getId());
+            ASSERT_EQ(expected[skip + i]->getKeyDouble(), result->getKeyDouble());
+        }
+        
+        ASSERT_EQ(nullptr, iter.Next());
+        ASSERT_EQ(rows, results->FilteredRows());
+        ASSERT_EQ(first + skip, results->Offset());
+    }
+}
+
+TEST_F(MapReduceTests, test63) {
+    auto db = MakeDatabase("mapreducetests63");
+    auto keys = MakeObject(R"({"keys":[5,3,5,1000]})")->getArray("keys");
+    
+    // the rows of each key are returned in the order of the keys, including repeated keys
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs, keys};
+    
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(doc.index % 100, doc.index); })");
+    auto results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    ASSERT_EQ(30, results->FilteredRows());
+    
+    auto iter = results->cbegin();
+    for (auto key : { 5, 3, 5 }) {
+        for (auto i = 0; i < 10; ++i, ++iter) {
+            ASSERT_EQ(key, (*iter)->getKeyDouble());
+            ASSERT_EQ(key + (i * 100), (*iter)->getValueDouble());
+        }
+    }
+    
+    rs::httpserver::QueryString qs2{"descending=true&skip=5&limit=10"};
+    GetViewOptions options2{qs2, keys};
+    
+    results = db->PostTempView(options2, mapObj);
+    ASSERT_EQ(10, results->FilteredRows());
+    ASSERT_EQ(5, (*results->cbegin())->getKeyDouble());
+    ASSERT_EQ(405, (*results->cbegin())->getValueDouble());
+    ASSERT_EQ(3, (*std::prev(results->cend()))->getKeyDouble());
+    
+    // reduced keys need to be grouped
+    mapObj = MakeMapObject(R"(function(doc) { emit(doc.index % 100, doc.index); })", "_count");
+    ASSERT_THROW(db->PostTempView(options, mapObj), MultiKeyReduceError);
+    
+    rs::httpserver::QueryString qs3{"group=true"};
+    GetViewOptions options3{qs3, keys};
+    
+    results = db->PostTempView(options3, mapObj);
+    auto reducedResults = results->ReducedResults();
+    ASSERT_EQ(3, reducedResults->size());
+    ASSERT_EQ(5, reducedResults->at(0)->getDouble(MapReduceResult::KeyIndex));
+    ASSERT_EQ(10, reducedResults->at(0)->getDouble(MapReduceResult::ValueIndex));
+    ASSERT_EQ(3, reducedResults->at(1)->getDouble(MapReduceResult::KeyIndex));
+    ASSERT_EQ(5, reducedResults->at(2)->getDouble(MapReduceResult::KeyIndex));
+    ASSERT_EQ(10, reducedResults->at(2)->getDouble(MapReduceResult::ValueIndex));
+}
+
+TEST_F(MapReduceTests, test64) {
+    auto db = MakeDatabase("mapreducetests64");
+    auto mapObj = MakeMapObject(R"(function(doc) { emit(doc.index % 10, null); })");
+    
+    for (auto descending : { false, true }) {
+        rs::httpserver::QueryString qs{descending ? "descending=true" : ""};
+        GetViewOptions options{qs};
+        
+        auto allResults = db->PostTempView(options, mapObj);
+        std::vector<map_reduce_result_ptr> allRows{allResults->cbegin(), allResults->cend()};
+        
+        // page through the rows by seeking to the key and id of the row after each page
+        std::vector<map_reduce_result_ptr> rows;
+        std::string query = (boost::format("limit=26%s") % (descending ? "&descending=true" : "")).str();
+        while (true) {
+            rs::httpserver::QueryString pageQs{query.c_str()};
+            GetViewOptions pageOptions{pageQs};
+            
+            auto results = db->PostTempView(pageOptions, mapObj);
+            std::vector<map_reduce_result_ptr> page{results->cbegin(), results->cend()};
+            rows.insert(rows.end(), page.cbegin(), page.cbegin() + std::min<std::size_t>(25, page.size()));
+            
+            if (page.size() <= 25) {
+                break;
+            }
+            
+            ASSERT_EQ(allResults->Offset() + rows.size(), results->Offset() + 25);
+            
+            query = (boost::format("limit=26&startkey=%d&startkey_docid=%s%s") % static_cast<int>(page[25]->getKeyDouble()) % page[25]->getId() % (descending ? "&descending=true" : "")).str();
+        }
+        
+        ASSERT_EQ(allRows.size(), rows.size());
+        for (decltype(rows.size()) i = 0; i < rows.size(); ++i) {
+            ASSERT_EQ(allRows[i], rows[i]);
+        }
+    }
+    
+    // the end id limits the rows of the last key
+    auto endId = MakeDocId(503);
+    auto query = (boost::format("startkey=2&endkey=3&endkey_docid=%s") % endId).str();
+    rs::httpserver::QueryString qs{query.c_str()};
+    GetViewOptions options{qs};
+    
+    auto results = db->PostTempView(options, mapObj);
+    ASSERT_EQ(151, results->FilteredRows());
+    ASSERT_STREQ(endId.c_str(), (*std::prev(results->cend()))->getId());
+    
+    query += "&inclusive_end=false";
+    rs::httpserver::QueryString qs2{query.c_str()};
+    GetViewOptions options2{qs2};
+    
+    results = db->PostTempView(options2, mapObj);
+    ASSERT_EQ(150, results->FilteredRows());
+}
+
+TEST_F(MapReduceTests, test65) {
+    auto db = MakeDatabase("mapreducetests65");
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    // a map which never returns is interrupted once the deadline passes
+    {
+        MapReduceCancellation::Scope scope{MapReduceCancellation::Create(250)};
+        
+        auto start = std::chrono::steady_clock::now();
+        ASSERT_THROW(db->PostTempView(options, MakeMapObject(R"(function(doc) { while (true) {} })")), QueryTimeoutError);
+        ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds{10});
+    }
+    
+    // a cancelled query doesn't start
+    {
+        auto cancellation = MapReduceCancellation::Create(Config::MapReduce::GetQueryTimeout());
+        cancellation->Cancel();
+        
+        MapReduceCancellation::Scope scope{cancellation};
+        ASSERT_THROW(db->PostTempView(options, MakeMapObject(R"(function(doc) { emit(doc.index, null); })")), QueryTimeoutError);
+    }
+    
+    // the map threads are free for the next query
+    auto results = db->PostTempView(options, MakeMapObject(R"(function(doc) { emit(doc._id, null); })"));
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+}
+
+
+TEST_F(MapReduceTests, test66) {
+    document_collections_ptr_array colls{DocumentCollection::Create()};
+    for (auto i = 0; i < docs_->getCount(); ++i) {
+        auto obj = docs_->getObject(i);
+        colls[0]->insert(Document::Create(obj->getString("_id"), obj, i + 1));
+    }
+    
+    // a map which emits a few rows only allocates a few row slots
+    auto task = MapReduce::MapReduceTask::Create(MakeMapObject(R"(function(doc) { if (doc.index == 42) { emit(doc.index, null); } })"));
+    auto results = MapReduce{}.Map(task, colls)[0];
+    ASSERT_EQ(1, results->size());
+    ASSERT_LT(results->arena_capacity(), 16);
+    
+    // the slots grow with the rows
+    auto allTask = MapReduce::MapReduceTask::Create(MakeMapObject(R"(function(doc) { emit(doc.index, null); })"));
+    results = MapReduce{}.Map(allTask, colls)[0];
+    ASSERT_EQ(docs_->getCount(), results->size());
+    ASSERT_LE(results->arena_capacity(), 2 * results->size() + 4);
+    
+    // an arena is only counted once however many times it is added
+    auto sources = boost::make_shared<map_reduce_result_array_ptr::element_type>();
+    sources->add_source(results);
+    sources->add_source(results);
+    ASSERT_EQ(results->arena_capacity(), sources->arena_capacity());
+}
+
+TEST_F(MapReduceTests, test67) {
+    auto keys = MakeObject(R"({"a":[1,"x",{"y":[true,null]}],"b":[1.5,"x"],"c":[1.0,"x",3]})");
+    
+    std::string a, b, c;
+    MapReduceResultComparers::AppendCollationKey(a, keys, 0);
+    MapReduceResultComparers::AppendCollationKey(b, keys, 1);
+    MapReduceResultComparers::AppendCollationKey(c, keys, 2);
+    
+    // the group_level prefixes of encoded array keys compare element by element
+    auto compare = [](const std::string& a, const std::string& b, std::uint64_t groupLevel) {
+        return MapReduceResult::CompareCollationKeys(a.data(), MapReduceResultComparers::GetArrayPrefixSize(a.data(), groupLevel),
+            b.data(), MapReduceResultComparers::GetArrayPrefixSize(b.data(), groupLevel));
+    };
+    
+    ASSERT_EQ(0, compare(a, c, 1));
+    ASSERT_EQ(0, compare(a, c, 2));
+    ASSERT_LT(compare(a, b, 1), 0);
+    ASSERT_GT(compare(b, a, 3), 0);
+    ASSERT_GT(compare(a, c, 3), 0);
+    ASSERT_GT(compare(b, c, 3), 0);
+    
+    // a prefix longer than the key is the whole key without the end of the array
+    ASSERT_EQ(a.size() - 1, MapReduceResultComparers::GetArrayPrefixSize(a.data(), 10));
+}
+
+TEST_F(MapReduceTests, test68) {
+    auto db = MakeViewDatabase("mapreduceviewtests68", "index", R"(function(doc) { emit(doc.index, null); })");
+    
+    rs::httpserver::QueryString qs{""};
+    GetViewOptions options{qs};
+    
+    auto results = db->GetDesignDocumentView(options, "test", "index");
+    ASSERT_EQ(docs_->getCount(), results->TotalRows());
+    
+    // a document is deleted and a design document added in the same collection, so the
+    // collection's size doesn't change and the design document isn't mapped
+    const auto collections = Config::GetCPUCount() * 2;
+    const auto designHash = Document::getIdHash("_design/other") % collections;
+    std::string id;
+    for (auto i = 0; i < docs_->getCount() && id.empty(); ++i) {
+        auto docId = MakeDocId(i);
+        if (Document::getIdHash(docId.c_str()) % collections == designHash) {
+            id = docId;
+        }
+    }
+    
+    ASSERT_FALSE(id.empty());
+    
+    auto doc = db->GetDocument(id.c_str());
+    db->DeleteDocument(id.c_str(), doc->getRev());
+    db->SetDesignDocument("other", MakeDesignObject("index", R"(function(doc) { emit(doc._id, null); })"));
+    
+    auto updatedResults = db->GetDesignDocumentView(options, "test", "index");
+    ASSERT_EQ(docs_->getCount() - 1, updatedResults->TotalRows());
+    ASSERT_EQ(docs_->getCount() - 1, std::distance(updatedResults->cbegin(), updatedResults->cend()));
+    
+    for (auto iter = updatedResults->cbegin(), end = updatedResults->cend(); iter != end; ++iter) {
+        ASSERT_STRNE(id.c_str(), (*iter)->getId());
+    }
+}
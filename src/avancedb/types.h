@@ -45,6 +45,8 @@ class MapReduceResult;
 using map_reduce_result_ptr = MapReduceResult*;
 class MapReduceResultArray;
 using map_reduce_result_array_ptr = boost::shared_ptr<MapReduceResultArray>;
+class MapReduceResultArena;
+using map_reduce_result_arena_ptr = boost::shared_ptr<MapReduceResultArena>;
 
 class MapReduceResults;
 using map_reduce_results_ptr = boost::shared_ptr<MapReduceResults>;
@@ -52,12 +54,24 @@ class MapReduceShardResults;
 using map_reduce_shard_results_ptr = boost::shared_ptr<MapReduceShardResults>;
 class MapReduceResultsIterator;
 
+class MapReduceNativeMap;
+using map_reduce_native_map_ptr = boost::shared_ptr<const MapReduceNativeMap>;
+
+class MapReduceView;
+using map_reduce_view_ptr = boost::shared_ptr<MapReduceView>;
+
 class MapReduceQueryKey;
 using map_reduce_query_key_ptr = boost::shared_ptr<MapReduceQueryKey>;
 
+class MapReduceCancellation;
+using map_reduce_cancellation_ptr = boost::shared_ptr<MapReduceCancellation>;
+
 using script_object_ptr = rs::scriptobject::ScriptObjectPtr;
 using script_array_ptr = rs::scriptobject::ScriptArrayPtr;
 
+using reduce_result_array = std::vector<script_array_ptr>;
+using reduce_result_array_ptr = boost::shared_ptr<reduce_result_array>;
+
 using sequence_type = unsigned long;
 
 #endif	/* TYPES_H */